@@ -4,7 +4,10 @@
 #include "utils/Asset.h"
 #include "utils/AssetManager.h"
 #include "utils/ResourceTypes.h"
+#include "utils/ResXMLQuery.h"
+#include "utils/ResXMLWriter.h"
 #include "utils/String8.h"
+#include "utils/StringInterner.h"
 
 using  namespace android;
 
@@ -33,6 +36,16 @@ static ssize_t indexOfAttribute(const ResXMLTree& tree, uint32_t attrRes)
     return -1;
 }
 
+/*
+ * Attribute strings come straight out of the pool as UTF-8; only UTF-16
+ * pools get transcoded.
+ */
+static String8 getAttributeString8(const ResXMLTree& tree, size_t idx)
+{
+    int32_t id = tree.getAttributeValueStringID(idx);
+    return id >= 0 ? tree.getStrings().string8ObjectAt(id) : String8();
+}
+
 String8 getAttribute(const ResXMLTree& tree, const char* ns,
                      const char* attr, String8* outError)
 {
@@ -47,9 +60,7 @@ String8 getAttribute(const ResXMLTree& tree, const char* ns,
             return String8();
         }
     }
-    size_t len;
-    const uint16_t* str = tree.getAttributeStringValue(idx, &len);
-    return str ? String8(str, len) : String8();
+    return getAttributeString8(tree, idx);
 }
 
 static String8 getAttribute(const ResXMLTree& tree, uint32_t attrRes, String8* outError)
@@ -65,15 +76,12 @@ static String8 getAttribute(const ResXMLTree& tree, uint32_t attrRes, String8* o
             return String8();
         }
     }
-    size_t len;
-    const uint16_t* str = tree.getAttributeStringValue(idx, &len);
-    return str ? String8(str, len) : String8();
+    return getAttributeString8(tree, idx);
 }
 
-static int32_t getIntegerAttribute(const ResXMLTree& tree, uint32_t attrRes,
-                                   String8* outError, int32_t defValue = -1)
+static int32_t getIntegerAttributeAt(const ResXMLTree& tree, ssize_t idx,
+                                     String8* outError, int32_t defValue = -1)
 {
-    ssize_t idx = indexOfAttribute(tree, attrRes);
     if (idx < 0) {
         return defValue;
     }
@@ -88,6 +96,12 @@ static int32_t getIntegerAttribute(const ResXMLTree& tree, uint32_t attrRes,
     return value.data;
 }
 
+static int32_t getIntegerAttribute(const ResXMLTree& tree, uint32_t attrRes,
+                                   String8* outError, int32_t defValue = -1)
+{
+    return getIntegerAttributeAt(tree, indexOfAttribute(tree, attrRes), outError, defValue);
+}
+
 static int32_t getResolvedIntegerAttribute(const ResTable* resTable, const ResXMLTree& tree,
                                            uint32_t attrRes, String8* outError, int32_t defValue = -1)
 {
@@ -109,19 +123,16 @@ static int32_t getResolvedIntegerAttribute(const ResTable* resTable, const ResXM
     return value.data;
 }
 
-static String8 getResolvedAttribute(const ResTable* resTable, const ResXMLTree& tree,
-                                    uint32_t attrRes, String8* outError)
+static String8 getResolvedAttributeAt(const ResTable* resTable, const ResXMLTree& tree,
+                                      ssize_t idx, String8* outError)
 {
-    ssize_t idx = indexOfAttribute(tree, attrRes);
     if (idx < 0) {
         return String8();
     }
     Res_value value;
     if (tree.getAttributeValue(idx, &value) != NO_ERROR) {
         if (value.dataType == Res_value::TYPE_STRING) {
-            size_t len;
-            const uint16_t* str = tree.getAttributeStringValue(idx, &len);
-            return str ? String8(str, len) : String8();
+            return getAttributeString8(tree, idx);
         }
         resTable->resolveReference(&value, 0);
         if (value.dataType != Res_value::TYPE_STRING) {
@@ -129,10 +140,68 @@ static String8 getResolvedAttribute(const ResTable* resTable, const ResXMLTree&
             return String8();
         }
     }
-    size_t len;
-    const Res_value* value2 = &value;
-    const uint16_t* str = const_cast<ResTable*>(resTable)->valueToString(value2, 0, NULL, &len);
-    return str ? String8(str, len) : String8();
+    const ResStringPool* pool = resTable->getTableStringBlock(0);
+    return pool ? pool->string8ObjectAt(value.data) : String8();
+}
+
+static String8 getResolvedAttribute(const ResTable* resTable, const ResXMLTree& tree,
+                                    uint32_t attrRes, String8* outError)
+{
+    return getResolvedAttributeAt(resTable, tree, indexOfAttribute(tree, attrRes), outError);
+}
+
+/*
+ * getResolvedAttribute() under each of 'count' configurations, with one
+ * batched table lookup instead of a setConfiguration() per configuration.
+ */
+static void getResolvedAttributeForConfigs(const ResTable* resTable, const ResXMLTree& tree,
+                                           uint32_t attrRes, const ResTable_config* configs,
+                                           size_t count, Vector<String8>* outValues,
+                                           String8* outError)
+{
+    outValues->clear();
+    outValues->insertAt(String8(), 0, count);
+    ssize_t idx = indexOfAttribute(tree, attrRes);
+    if (idx < 0 || count == 0) {
+        return;
+    }
+    Res_value value;
+    if (tree.getAttributeValue(idx, &value) < 0) {
+        return;
+    }
+    if (value.dataType == Res_value::TYPE_STRING) {
+        String8 str = getAttributeString8(tree, idx);
+        for (size_t i = 0; i < count; i++) {
+            outValues->editItemAt(i) = str;
+        }
+        return;
+    }
+    if (value.dataType != Res_value::TYPE_REFERENCE) {
+        // nothing to look up; the same failure in every configuration
+        if (outError != NULL) *outError = "attribute is not a string value";
+        return;
+    }
+
+    Vector<Res_value> values;
+    values.insertAt(value, 0, count);
+    Vector<ssize_t> blocks;
+    blocks.insertAt((ssize_t)0, 0, count);
+    if (resTable->getResourceForConfigs(value.data, configs, count,
+                                        values.editArray(), blocks.editArray()) != NO_ERROR) {
+        // resolveReference() leaves the reference itself in place
+        if (outError != NULL) *outError = "attribute is not a string value";
+        return;
+    }
+    for (size_t i = 0; i < count; i++) {
+        if (blocks[i] < 0 || values[i].dataType != Res_value::TYPE_STRING) {
+            if (outError != NULL) *outError = "attribute is not a string value";
+            continue;
+        }
+        const ResStringPool* pool = resTable->getTableStringBlock(blocks[i]);
+        if (pool != NULL) {
+            outValues->editItemAt(i) = pool->string8ObjectAt(values[i].data);
+        }
+    }
 }
 
 enum {
@@ -166,6 +235,218 @@ enum {
     PUBLIC_KEY_ATTR = 0x010103a6,
 };
 
+/*
+ * Elements that read several attributes look them all up in one pass
+ * with gatherAttributes().  Each ID list must stay sorted; the enum
+ * after it gives each attribute's slot.
+ */
+static const uint32_t kUsesSdkAttrs[] = {
+    MIN_SDK_VERSION_ATTR, TARGET_SDK_VERSION_ATTR, MAX_SDK_VERSION_ATTR,
+};
+enum { SDK_MIN, SDK_TARGET, SDK_MAX, NUM_SDK_ATTRS };
+
+static const uint32_t kUsesConfigurationAttrs[] = {
+    REQ_TOUCH_SCREEN_ATTR, REQ_KEYBOARD_TYPE_ATTR, REQ_HARD_KEYBOARD_ATTR,
+    REQ_NAVIGATION_ATTR, REQ_FIVE_WAY_NAV_ATTR,
+};
+enum { CONF_TOUCH_SCREEN, CONF_KEYBOARD_TYPE, CONF_HARD_KEYBOARD, CONF_NAVIGATION,
+       CONF_FIVE_WAY_NAV, NUM_CONF_ATTRS };
+
+static const uint32_t kSupportsScreensAttrs[] = {
+    ANY_DENSITY_ATTR, SMALL_SCREEN_ATTR, NORMAL_SCREEN_ATTR, LARGE_SCREEN_ATTR,
+    XLARGE_SCREEN_ATTR, REQUIRES_SMALLEST_WIDTH_DP_ATTR, COMPATIBLE_WIDTH_LIMIT_DP_ATTR,
+    LARGEST_WIDTH_LIMIT_DP_ATTR,
+};
+enum { SCR_ANY_DENSITY, SCR_SMALL, SCR_NORMAL, SCR_LARGE, SCR_XLARGE,
+       SCR_REQUIRES_SMALLEST_WIDTH_DP, SCR_COMPATIBLE_WIDTH_LIMIT_DP,
+       SCR_LARGEST_WIDTH_LIMIT_DP, NUM_SCR_ATTRS };
+
+static const uint32_t kScreenAttrs[] = {
+    SCREEN_SIZE_ATTR, SCREEN_DENSITY_ATTR,
+};
+enum { SCREEN_SIZE, SCREEN_DENSITY, NUM_SCREEN_ATTRS };
+
+/*
+ * Names the badging code dispatches on.  They are interned first, in this
+ * order, so each one's atom is its enum value and name checks are integer
+ * compares.  The TAG_* names are also handed to the manifest tree as its
+ * element codes (names[i] gets code i+1), so elements dispatch on
+ * getElementCode() without touching the interner.
+ */
+enum {
+    TAG_MANIFEST = 1,
+    TAG_APPLICATION,
+    TAG_USES_SDK,
+    TAG_USES_CONFIGURATION,
+    TAG_SUPPORTS_SCREENS,
+    TAG_USES_FEATURE,
+    TAG_USES_PERMISSION,
+    TAG_USES_PACKAGE,
+    TAG_ORIGINAL_PACKAGE,
+    TAG_SUPPORTS_GL_TEXTURE,
+    TAG_COMPATIBLE_SCREENS,
+    TAG_PACKAGE_VERIFIER,
+    TAG_ACTIVITY,
+    TAG_USES_LIBRARY,
+    TAG_RECEIVER,
+    TAG_SERVICE,
+    TAG_INTENT_FILTER,
+    TAG_ACTION,
+    TAG_CATEGORY,
+    TAG_SCREEN,
+    NUM_TAGS = TAG_SCREEN,
+    FEATURE_CAMERA,
+    FEATURE_CAMERA_AUTOFOCUS,
+    FEATURE_CAMERA_FLASH,
+    FEATURE_LOCATION,
+    FEATURE_LOCATION_NETWORK,
+    FEATURE_LOCATION_GPS,
+    FEATURE_BLUETOOTH,
+    FEATURE_TOUCHSCREEN,
+    FEATURE_TOUCHSCREEN_MULTITOUCH,
+    FEATURE_TOUCHSCREEN_MULTITOUCH_DISTINCT,
+    FEATURE_MICROPHONE,
+    FEATURE_WIFI,
+    FEATURE_TELEPHONY,
+    FEATURE_TELEPHONY_GSM,
+    FEATURE_TELEPHONY_CDMA,
+    FEATURE_SCREEN_PORTRAIT,
+    FEATURE_SCREEN_LANDSCAPE,
+    PERMISSION_CAMERA,
+    PERMISSION_ACCESS_FINE_LOCATION,
+    PERMISSION_ACCESS_MOCK_LOCATION,
+    PERMISSION_ACCESS_COARSE_LOCATION,
+    PERMISSION_ACCESS_LOCATION_EXTRA_COMMANDS,
+    PERMISSION_INSTALL_LOCATION_PROVIDER,
+    PERMISSION_BLUETOOTH,
+    PERMISSION_BLUETOOTH_ADMIN,
+    PERMISSION_RECORD_AUDIO,
+    PERMISSION_ACCESS_WIFI_STATE,
+    PERMISSION_CHANGE_WIFI_STATE,
+    PERMISSION_CHANGE_WIFI_MULTICAST_STATE,
+    PERMISSION_CALL_PHONE,
+    PERMISSION_CALL_PRIVILEGED,
+    PERMISSION_MODIFY_PHONE_STATE,
+    PERMISSION_PROCESS_OUTGOING_CALLS,
+    PERMISSION_READ_SMS,
+    PERMISSION_RECEIVE_SMS,
+    PERMISSION_RECEIVE_MMS,
+    PERMISSION_RECEIVE_WAP_PUSH,
+    PERMISSION_SEND_SMS,
+    PERMISSION_WRITE_APN_SETTINGS,
+    PERMISSION_WRITE_SMS,
+    ACTION_MAIN,
+    ACTION_APPWIDGET_UPDATE,
+    ACTION_INPUT_METHOD,
+    ACTION_WALLPAPER_SERVICE,
+    ACTION_SEARCH,
+    CATEGORY_LAUNCHER,
+    NUM_KNOWN_ATOMS
+};
+
+static const char* const kKnownAtoms[NUM_KNOWN_ATOMS] = {
+    NULL,
+    "manifest",
+    "application",
+    "uses-sdk",
+    "uses-configuration",
+    "supports-screens",
+    "uses-feature",
+    "uses-permission",
+    "uses-package",
+    "original-package",
+    "supports-gl-texture",
+    "compatible-screens",
+    "package-verifier",
+    "activity",
+    "uses-library",
+    "receiver",
+    "service",
+    "intent-filter",
+    "action",
+    "category",
+    "screen",
+    "android.hardware.camera",
+    "android.hardware.camera.autofocus",
+    "android.hardware.camera.flash",
+    "android.hardware.location",
+    "android.hardware.location.network",
+    "android.hardware.location.gps",
+    "android.hardware.bluetooth",
+    "android.hardware.touchscreen",
+    "android.hardware.touchscreen.multitouch",
+    "android.hardware.touchscreen.multitouch.distinct",
+    "android.hardware.microphone",
+    "android.hardware.wifi",
+    "android.hardware.telephony",
+    "android.hardware.telephony.gsm",
+    "android.hardware.telephony.cdma",
+    "android.hardware.screen.portrait",
+    "android.hardware.screen.landscape",
+    "android.permission.CAMERA",
+    "android.permission.ACCESS_FINE_LOCATION",
+    "android.permission.ACCESS_MOCK_LOCATION",
+    "android.permission.ACCESS_COARSE_LOCATION",
+    "android.permission.ACCESS_LOCATION_EXTRA_COMMANDS",
+    "android.permission.INSTALL_LOCATION_PROVIDER",
+    "android.permission.BLUETOOTH",
+    "android.permission.BLUETOOTH_ADMIN",
+    "android.permission.RECORD_AUDIO",
+    "android.permission.ACCESS_WIFI_STATE",
+    "android.permission.CHANGE_WIFI_STATE",
+    "android.permission.CHANGE_WIFI_MULTICAST_STATE",
+    "android.permission.CALL_PHONE",
+    "android.permission.CALL_PRIVILEGED",
+    "android.permission.MODIFY_PHONE_STATE",
+    "android.permission.PROCESS_OUTGOING_CALLS",
+    "android.permission.READ_SMS",
+    "android.permission.RECEIVE_SMS",
+    "android.permission.RECEIVE_MMS",
+    "android.permission.RECEIVE_WAP_PUSH",
+    "android.permission.SEND_SMS",
+    "android.permission.WRITE_APN_SETTINGS",
+    "android.permission.WRITE_SMS",
+    "android.intent.action.MAIN",
+    "android.appwidget.action.APPWIDGET_UPDATE",
+    "android.view.InputMethod",
+    "android.service.wallpaper.WallpaperService",
+    "android.intent.action.SEARCH",
+    "android.intent.category.LAUNCHER",
+};
+
+static void internKnownAtoms(StringInterner& atoms)
+{
+    for (size_t i = 1; i < NUM_KNOWN_ATOMS; i++) {
+        atoms.intern(kKnownAtoms[i]);
+    }
+}
+
+/*
+ * Like getAttribute(), but returns the interned value; an empty or
+ * missing value is NO_ATOM.
+ */
+static uint32_t getAttributeAtom(StringInterner& atoms, const ResXMLTree& tree,
+                                 uint32_t attrRes, String8* outError)
+{
+    ssize_t idx = indexOfAttribute(tree, attrRes);
+    if (idx < 0) {
+        return StringInterner::NO_ATOM;
+    }
+    Res_value value;
+    if (tree.getAttributeValue(idx, &value) != NO_ERROR) {
+        if (value.dataType != Res_value::TYPE_STRING) {
+            if (outError != NULL) *outError = "attribute is not a string value";
+            return StringInterner::NO_ATOM;
+        }
+    }
+    uint32_t atom = atoms.atomAt(tree.getStrings(), tree.getAttributeValueStringID(idx));
+    size_t len;
+    if (atoms.string(atom, &len) == NULL || len == 0) {
+        return StringInterner::NO_ATOM;
+    }
+    return atom;
+}
+
 const char *getComponentName(String8 &pkgName, String8 &componentName) {
     ssize_t idx = componentName.find(".");
     String8 retStr(pkgName);
@@ -181,12 +462,72 @@ const char *getComponentName(String8 &pkgName, String8 &componentName) {
 }
 
 
+/*
+ * Badging lines that are just one attribute of a top-level element.
+ * They come from a ResXMLQuery fed by the badging walk and are printed
+ * as each element is reached, so adding one is a line here rather than
+ * another case in doDump().
+ */
+static const struct {
+    const char* selector;
+    const char* format;
+} kManifestFields[] = {
+    { "manifest/uses-package/@android:name",        "uses-package:'%s'\n" },
+    { "manifest/original-package/@android:name",    "original-package:'%s'\n" },
+    { "manifest/supports-gl-texture/@android:name", "supports-gl-texture:'%s'\n" },
+};
+enum { NUM_MANIFEST_FIELDS = sizeof(kManifestFields) / sizeof(kManifestFields[0]) };
+
+static void printManifestFields(const ResXMLQuery& fields, size_t* printed) {
+    for (size_t i = 0; i < NUM_MANIFEST_FIELDS; i++) {
+        for (; printed[i] < fields.getMatchCount(i); printed[i]++) {
+            const String8& value = fields.getMatch(i, printed[i]);
+            if (value.length() > 0) {
+                writeString(kManifestFields[i].format, value.string());
+            }
+        }
+    }
+}
+
+static void printScreen(ResXMLTree& tree, bool* first) {
+    ssize_t idx[NUM_SCREEN_ATTRS];
+    tree.gatherAttributes(kScreenAttrs, NUM_SCREEN_ATTRS, idx);
+    int32_t screenSize = getIntegerAttributeAt(tree, idx[SCREEN_SIZE], NULL, -1);
+    int32_t screenDensity = getIntegerAttributeAt(tree, idx[SCREEN_DENSITY], NULL, -1);
+    if (screenSize > 0 && screenDensity > 0) {
+        if (!*first) {
+            writeString(",");
+        }
+        *first = false;
+        writeString("'%d/%d'", screenSize, screenDensity);
+    }
+}
+
 static void printCompatibleScreens(ResXMLTree& tree) {
-    size_t len;
     ResXMLTree::event_code_t code;
     int depth = 0;
     bool first = true;
     writeString("compatible-screens:");
+
+    // With the element index, the subtree is the run of deeper elements
+    // that follows this one; visit those and jump to the closing tag.
+    const ssize_t self = tree.getElementIndex();
+    if (self >= 0) {
+        const uint32_t selfDepth = tree.getElement(self)->depth;
+        const size_t N = tree.getElementCount();
+        for (size_t i = self+1; i < N && tree.getElement(i)->depth > selfDepth; i++) {
+            tree.seekToElement(i);
+            if (tree.getElementCode() == TAG_SCREEN) {
+                printScreen(tree, &first);
+            }
+        }
+        if (tree.seekToElementEnd(self) == NO_ERROR) {
+            writeString("\n");
+            return;
+        }
+        // never closed; let the walk below run into the end of the document
+    }
+
     while ((code=tree.next()) != ResXMLTree::END_DOCUMENT && code != ResXMLTree::BAD_DOCUMENT) {
         if (code == ResXMLTree::END_TAG) {
             depth--;
@@ -199,19 +540,8 @@ static void printCompatibleScreens(ResXMLTree& tree) {
             continue;
         }
         depth++;
-        String8 tag(tree.getElementName(&len));
-        if (tag == "screen") {
-            int32_t screenSize = getIntegerAttribute(tree,
-                                                     SCREEN_SIZE_ATTR, NULL, -1);
-            int32_t screenDensity = getIntegerAttribute(tree,
-                                                        SCREEN_DENSITY_ATTR, NULL, -1);
-            if (screenSize > 0 && screenDensity > 0) {
-                if (!first) {
-                    writeString(",");
-                }
-                first = false;
-                writeString("'%d/%d'", screenSize, screenDensity);
-            }
+        if (tree.getElementCode() == TAG_SCREEN) {
+            printScreen(tree, &first);
         }
     }
     writeString("\n");
@@ -225,11 +555,14 @@ static void printCompatibleScreens(ResXMLTree& tree) {
 int doDump(const char * filename)
 {
     int result = 0;
-    Asset *asset = NULL;
+    sp<AssetData> manifest;
 
     const char *option = "badging";
 
     AssetManager assets;
+    assets.setAnalysisMode(true);
+    StringInterner atoms;
+    internKnownAtoms(atoms);
     void *assetsCookie;
     if (!assets.addAssetPath(String8(filename), &assetsCookie))
     {
@@ -249,17 +582,34 @@ int doDump(const char * filename)
     config.smallestScreenWidthDp = 320;
     assets.setConfiguration(config);
 
+    {
+        // Bring the manifest and the resource table in with one read
+        // before we parse either of them.
+        static const char* const kHotEntries[] = {
+            "AndroidManifest.xml",
+            "resources.arsc",
+        };
+        assets.prefetchNonAssets(assetsCookie, kHotEntries,
+                                 sizeof(kHotEntries) / sizeof(kHotEntries[0]));
+    }
+
     const ResTable &res = assets.getResources(false);
     {
         ResXMLTree tree;
-        asset = assets.openNonAsset("AndroidManifest.xml", Asset::ACCESS_BUFFER);
+        manifest = AssetData::create(
+                assets.openNonAsset("AndroidManifest.xml", Asset::ACCESS_BUFFER));
 
-        if (asset == NULL)
+        if (manifest == NULL)
         {
             goto bail;
         }
 
-        if (tree.setTo(asset->getBuffer(true), asset->getLength()) != NO_ERROR)
+        // The manifest is walked more than once; check it up front.
+        if (tree.setTo(manifest, ResXMLTree::INDEX_NODES|ResXMLTree::INDEX_ELEMENTS) != NO_ERROR)
+        {
+            goto bail;
+        }
+        if (tree.setElementCodes(kKnownAtoms + TAG_MANIFEST, NUM_TAGS) != NO_ERROR)
         {
             goto bail;
         }
@@ -281,7 +631,6 @@ int doDump(const char * filename)
                 densities.add(dens);
             }
 
-            size_t len;
             ResXMLTree::event_code_t code;
             int depth = 0;
             String8 error;
@@ -366,9 +715,23 @@ int doDump(const char * filename)
             String8 activityIcon;
             String8 receiverName;
             String8 serviceName;
+
+            ResXMLQuery fields;
+            size_t printedFields[NUM_MANIFEST_FIELDS];
+            for (size_t i = 0; i < NUM_MANIFEST_FIELDS; i++)
+            {
+                fields.add(kManifestFields[i].selector);
+                printedFields[i] = 0;
+            }
+            if (fields.begin(tree) != NO_ERROR)
+            {
+                goto bail;
+            }
+
             while ((code = tree.next()) != ResXMLTree::END_DOCUMENT &&
                    code != ResXMLTree::BAD_DOCUMENT)
             {
+                fields.feed(tree, code);
                 if (code == ResXMLTree::END_TAG)
                 {
                     depth--;
@@ -428,10 +791,11 @@ int doDump(const char * filename)
                     continue;
                 }
                 depth++;
-                String8 tag(tree.getElementName(&len));
+                printManifestFields(fields, printedFields);
+                const uint32_t tag = tree.getElementCode();
                 if (depth == 1)
                 {
-                    if (tag != "manifest")
+                    if (tag != TAG_MANIFEST)
                     {
                         goto bail;
                     }
@@ -459,17 +823,35 @@ int doDump(const char * filename)
                 } else if (depth == 2)
                 {
                     withinApplication = false;
-                    if (tag == "application")
+                    switch (tag)
+                    {
+                    case TAG_APPLICATION:
                     {
                         withinApplication = true;
 
+                        // Every locale's label, then every density's icon, in
+                        // one lookup each, without switching the configuration.
                         String8 label;
                         const size_t NL = locales.size();
+                        Vector<ResTable_config> localeConfigs;
                         for (size_t i = 0; i < NL; i++)
                         {
                             const char *localeStr = locales[i].string();
-                            assets.setLocale(localeStr != NULL ? localeStr : "");
-                            String8 llabel = getResolvedAttribute(&res, tree, LABEL_ATTR, &error);
+                            const size_t llen = localeStr != NULL ? strlen(localeStr) : 0;
+                            ResTable_config tmpConfig = config;
+                            tmpConfig.language[0] = llen >= 2 ? localeStr[0] : 0;
+                            tmpConfig.language[1] = llen >= 2 ? localeStr[1] : 0;
+                            tmpConfig.country[0] = llen >= 5 ? localeStr[3] : 0;
+                            tmpConfig.country[1] = llen >= 5 ? localeStr[4] : 0;
+                            localeConfigs.add(tmpConfig);
+                        }
+                        Vector<String8> labels;
+                        getResolvedAttributeForConfigs(&res, tree, LABEL_ATTR,
+                                                       localeConfigs.array(), NL, &labels, &error);
+                        for (size_t i = 0; i < NL; i++)
+                        {
+                            const char *localeStr = locales[i].string();
+                            const String8& llabel = labels[i];
                             if (llabel != "")
                             {
                                 if (localeStr == NULL || strlen(localeStr) == 0)
@@ -488,19 +870,24 @@ int doDump(const char * filename)
                             }
                         }
 
-                        ResTable_config tmpConfig = config;
                         const size_t ND = densities.size();
+                        Vector<ResTable_config> densityConfigs;
                         for (size_t i = 0; i < ND; i++)
                         {
+                            ResTable_config tmpConfig = config;
                             tmpConfig.density = densities[i];
-                            assets.setConfiguration(tmpConfig);
-                            String8 icon = getResolvedAttribute(&res, tree, ICON_ATTR, &error);
-                            if (icon != "")
+                            densityConfigs.add(tmpConfig);
+                        }
+                        Vector<String8> icons;
+                        getResolvedAttributeForConfigs(&res, tree, ICON_ATTR,
+                                                       densityConfigs.array(), ND, &icons, &error);
+                        for (size_t i = 0; i < ND; i++)
+                        {
+                            if (icons[i] != "")
                             {
-                                writeString("application-icon-%d:'%s'\n", densities[i], icon.string());
+                                writeString("application-icon-%d:'%s'\n", densities[i], icons[i].string());
                             }
                         }
-                        assets.setConfiguration(config);
 
                         String8 icon = getResolvedAttribute(&res, tree, ICON_ATTR, &error);
                         if (error != "")
@@ -518,14 +905,18 @@ int doDump(const char * filename)
                         {
                             writeString("testOnly='%d'\n", testOnly);
                         }
-                    } else if (tag == "uses-sdk")
+                        break;
+                    }
+                    case TAG_USES_SDK:
                     {
-                        int32_t code = getIntegerAttribute(tree, MIN_SDK_VERSION_ATTR, &error);
+                        ssize_t idx[NUM_SDK_ATTRS];
+                        tree.gatherAttributes(kUsesSdkAttrs, NUM_SDK_ATTRS, idx);
+                        int32_t code = getIntegerAttributeAt(tree, idx[SDK_MIN], &error);
                         if (error != "")
                         {
                             error = "";
-                            String8 name = getResolvedAttribute(&res, tree, MIN_SDK_VERSION_ATTR,
-                                                                &error);
+                            String8 name = getResolvedAttributeAt(&res, tree, idx[SDK_MIN],
+                                                                  &error);
                             if (error != "")
                             {
                                 goto bail;
@@ -537,17 +928,17 @@ int doDump(const char * filename)
                             targetSdk = code;
                             writeString("sdkVersion:'%d'\n", code);
                         }
-                        code = getIntegerAttribute(tree, MAX_SDK_VERSION_ATTR, NULL, -1);
+                        code = getIntegerAttributeAt(tree, idx[SDK_MAX], NULL, -1);
                         if (code != -1)
                         {
                             writeString("maxSdkVersion:'%d'\n", code);
                         }
-                        code = getIntegerAttribute(tree, TARGET_SDK_VERSION_ATTR, &error);
+                        code = getIntegerAttributeAt(tree, idx[SDK_TARGET], &error);
                         if (error != "")
                         {
                             error = "";
-                            String8 name = getResolvedAttribute(&res, tree, TARGET_SDK_VERSION_ATTR,
-                                                                &error);
+                            String8 name = getResolvedAttributeAt(&res, tree, idx[SDK_TARGET],
+                                                                  &error);
                             if (error != "")
                             {
                                 goto bail;
@@ -562,21 +953,25 @@ int doDump(const char * filename)
                             }
                             writeString("targetSdkVersion:'%d'\n", code);
                         }
-                    } else if (tag == "uses-configuration")
+                        break;
+                    }
+                    case TAG_USES_CONFIGURATION:
                     {
-                        int32_t reqTouchScreen = getIntegerAttribute(tree,
-                                                                     REQ_TOUCH_SCREEN_ATTR, NULL,
-                                                                     0);
-                        int32_t reqKeyboardType = getIntegerAttribute(tree,
-                                                                      REQ_KEYBOARD_TYPE_ATTR, NULL,
-                                                                      0);
-                        int32_t reqHardKeyboard = getIntegerAttribute(tree,
-                                                                      REQ_HARD_KEYBOARD_ATTR, NULL,
-                                                                      0);
-                        int32_t reqNavigation = getIntegerAttribute(tree,
-                                                                    REQ_NAVIGATION_ATTR, NULL, 0);
-                        int32_t reqFiveWayNav = getIntegerAttribute(tree,
-                                                                    REQ_FIVE_WAY_NAV_ATTR, NULL, 0);
+                        ssize_t idx[NUM_CONF_ATTRS];
+                        tree.gatherAttributes(kUsesConfigurationAttrs, NUM_CONF_ATTRS, idx);
+                        int32_t reqTouchScreen = getIntegerAttributeAt(tree,
+                                                                       idx[CONF_TOUCH_SCREEN], NULL,
+                                                                       0);
+                        int32_t reqKeyboardType = getIntegerAttributeAt(tree,
+                                                                        idx[CONF_KEYBOARD_TYPE], NULL,
+                                                                        0);
+                        int32_t reqHardKeyboard = getIntegerAttributeAt(tree,
+                                                                        idx[CONF_HARD_KEYBOARD], NULL,
+                                                                        0);
+                        int32_t reqNavigation = getIntegerAttributeAt(tree,
+                                                                      idx[CONF_NAVIGATION], NULL, 0);
+                        int32_t reqFiveWayNav = getIntegerAttributeAt(tree,
+                                                                      idx[CONF_FIVE_WAY_NAV], NULL, 0);
                         writeString("uses-configuration:");
                         if (reqTouchScreen != 0)
                         {
@@ -599,97 +994,103 @@ int doDump(const char * filename)
                             writeString(" reqFiveWayNav='%d'", reqFiveWayNav);
                         }
                         writeString("\n");
-                    } else if (tag == "supports-screens")
+                        break;
+                    }
+                    case TAG_SUPPORTS_SCREENS:
                     {
-                        smallScreen = getIntegerAttribute(tree,
-                                                          SMALL_SCREEN_ATTR, NULL, 1);
-                        normalScreen = getIntegerAttribute(tree,
-                                                           NORMAL_SCREEN_ATTR, NULL, 1);
-                        largeScreen = getIntegerAttribute(tree,
-                                                          LARGE_SCREEN_ATTR, NULL, 1);
-                        xlargeScreen = getIntegerAttribute(tree,
-                                                           XLARGE_SCREEN_ATTR, NULL, 1);
-                        anyDensity = getIntegerAttribute(tree,
-                                                         ANY_DENSITY_ATTR, NULL, 1);
-                        requiresSmallestWidthDp = getIntegerAttribute(tree,
-                                                                      REQUIRES_SMALLEST_WIDTH_DP_ATTR,
-                                                                      NULL, 0);
-                        compatibleWidthLimitDp = getIntegerAttribute(tree,
-                                                                     COMPATIBLE_WIDTH_LIMIT_DP_ATTR,
-                                                                     NULL, 0);
-                        largestWidthLimitDp = getIntegerAttribute(tree,
-                                                                  LARGEST_WIDTH_LIMIT_DP_ATTR, NULL,
-                                                                  0);
-                    } else if (tag == "uses-feature")
+                        ssize_t idx[NUM_SCR_ATTRS];
+                        tree.gatherAttributes(kSupportsScreensAttrs, NUM_SCR_ATTRS, idx);
+                        smallScreen = getIntegerAttributeAt(tree,
+                                                            idx[SCR_SMALL], NULL, 1);
+                        normalScreen = getIntegerAttributeAt(tree,
+                                                             idx[SCR_NORMAL], NULL, 1);
+                        largeScreen = getIntegerAttributeAt(tree,
+                                                            idx[SCR_LARGE], NULL, 1);
+                        xlargeScreen = getIntegerAttributeAt(tree,
+                                                             idx[SCR_XLARGE], NULL, 1);
+                        anyDensity = getIntegerAttributeAt(tree,
+                                                           idx[SCR_ANY_DENSITY], NULL, 1);
+                        requiresSmallestWidthDp = getIntegerAttributeAt(tree,
+                                                                        idx[SCR_REQUIRES_SMALLEST_WIDTH_DP],
+                                                                        NULL, 0);
+                        compatibleWidthLimitDp = getIntegerAttributeAt(tree,
+                                                                       idx[SCR_COMPATIBLE_WIDTH_LIMIT_DP],
+                                                                       NULL, 0);
+                        largestWidthLimitDp = getIntegerAttributeAt(tree,
+                                                                    idx[SCR_LARGEST_WIDTH_LIMIT_DP], NULL,
+                                                                    0);
+                        break;
+                    }
+                    case TAG_USES_FEATURE:
                     {
-                        String8 name = getAttribute(tree, NAME_ATTR, &error);
+                        uint32_t name = getAttributeAtom(atoms, tree, NAME_ATTR, &error);
 
-                        if (name != "" && error == "")
+                        if (name != StringInterner::NO_ATOM && error == "")
                         {
                             int req = getIntegerAttribute(tree,
                                                           REQUIRED_ATTR, NULL, 1);
 
-                            if (name == "android.hardware.camera")
+                            if (name == FEATURE_CAMERA)
                             {
                                 specCameraFeature = true;
-                            } else if (name == "android.hardware.camera.autofocus")
+                            } else if (name == FEATURE_CAMERA_AUTOFOCUS)
                             {
                                 // these have no corresponding permission to check for,
                                 // but should imply the foundational camera permission
                                 reqCameraAutofocusFeature = reqCameraAutofocusFeature || req;
                                 specCameraAutofocusFeature = true;
-                            } else if (req && (name == "android.hardware.camera.flash"))
+                            } else if (req && (name == FEATURE_CAMERA_FLASH))
                             {
                                 // these have no corresponding permission to check for,
                                 // but should imply the foundational camera permission
                                 reqCameraFlashFeature = true;
-                            } else if (name == "android.hardware.location")
+                            } else if (name == FEATURE_LOCATION)
                             {
                                 specLocationFeature = true;
-                            } else if (name == "android.hardware.location.network")
+                            } else if (name == FEATURE_LOCATION_NETWORK)
                             {
                                 specNetworkLocFeature = true;
                                 reqNetworkLocFeature = reqNetworkLocFeature || req;
-                            } else if (name == "android.hardware.location.gps")
+                            } else if (name == FEATURE_LOCATION_GPS)
                             {
                                 specGpsFeature = true;
                                 reqGpsFeature = reqGpsFeature || req;
-                            } else if (name == "android.hardware.bluetooth")
+                            } else if (name == FEATURE_BLUETOOTH)
                             {
                                 specBluetoothFeature = true;
-                            } else if (name == "android.hardware.touchscreen")
+                            } else if (name == FEATURE_TOUCHSCREEN)
                             {
                                 specTouchscreenFeature = true;
-                            } else if (name == "android.hardware.touchscreen.multitouch")
+                            } else if (name == FEATURE_TOUCHSCREEN_MULTITOUCH)
                             {
                                 specMultitouchFeature = true;
-                            } else if (name == "android.hardware.touchscreen.multitouch.distinct")
+                            } else if (name == FEATURE_TOUCHSCREEN_MULTITOUCH_DISTINCT)
                             {
                                 reqDistinctMultitouchFeature = reqDistinctMultitouchFeature || req;
-                            } else if (name == "android.hardware.microphone")
+                            } else if (name == FEATURE_MICROPHONE)
                             {
                                 specMicrophoneFeature = true;
-                            } else if (name == "android.hardware.wifi")
+                            } else if (name == FEATURE_WIFI)
                             {
                                 specWiFiFeature = true;
-                            } else if (name == "android.hardware.telephony")
+                            } else if (name == FEATURE_TELEPHONY)
                             {
                                 specTelephonyFeature = true;
-                            } else if (req && (name == "android.hardware.telephony.gsm" ||
-                                               name == "android.hardware.telephony.cdma"))
+                            } else if (req && (name == FEATURE_TELEPHONY_GSM ||
+                                               name == FEATURE_TELEPHONY_CDMA))
                             {
                                 // these have no corresponding permission to check for,
                                 // but should imply the foundational telephony permission
                                 reqTelephonySubFeature = true;
-                            } else if (name == "android.hardware.screen.portrait")
+                            } else if (name == FEATURE_SCREEN_PORTRAIT)
                             {
                                 specScreenPortraitFeature = true;
-                            } else if (name == "android.hardware.screen.landscape")
+                            } else if (name == FEATURE_SCREEN_LANDSCAPE)
                             {
                                 specScreenLandscapeFeature = true;
                             }
                             writeString("uses-feature%s:'%s'\n",
-                                   req ? "" : "-not-required", name.string());
+                                   req ? "" : "-not-required", atoms.string(name));
                         } else
                         {
                             int vers = getIntegerAttribute(tree,
@@ -699,94 +1100,73 @@ int doDump(const char * filename)
                                 writeString("uses-gl-es:'0x%x'\n", vers);
                             }
                         }
-                    } else if (tag == "uses-permission")
+                        break;
+                    }
+                    case TAG_USES_PERMISSION:
                     {
-                        String8 name = getAttribute(tree, NAME_ATTR, &error);
-                        if (name != "" && error == "")
+                        uint32_t name = getAttributeAtom(atoms, tree, NAME_ATTR, &error);
+                        if (name != StringInterner::NO_ATOM && error == "")
                         {
-                            if (name == "android.permission.CAMERA")
+                            if (name == PERMISSION_CAMERA)
                             {
                                 hasCameraPermission = true;
-                            } else if (name == "android.permission.ACCESS_FINE_LOCATION")
+                            } else if (name == PERMISSION_ACCESS_FINE_LOCATION)
                             {
                                 hasGpsPermission = true;
-                            } else if (name == "android.permission.ACCESS_MOCK_LOCATION")
+                            } else if (name == PERMISSION_ACCESS_MOCK_LOCATION)
                             {
                                 hasMockLocPermission = true;
-                            } else if (name == "android.permission.ACCESS_COARSE_LOCATION")
+                            } else if (name == PERMISSION_ACCESS_COARSE_LOCATION)
                             {
                                 hasCoarseLocPermission = true;
                             } else if (
-                                    name == "android.permission.ACCESS_LOCATION_EXTRA_COMMANDS" ||
-                                    name == "android.permission.INSTALL_LOCATION_PROVIDER")
+                                    name == PERMISSION_ACCESS_LOCATION_EXTRA_COMMANDS ||
+                                    name == PERMISSION_INSTALL_LOCATION_PROVIDER)
                             {
                                 hasGeneralLocPermission = true;
-                            } else if (name == "android.permission.BLUETOOTH" ||
-                                       name == "android.permission.BLUETOOTH_ADMIN")
+                            } else if (name == PERMISSION_BLUETOOTH ||
+                                       name == PERMISSION_BLUETOOTH_ADMIN)
                             {
                                 hasBluetoothPermission = true;
-                            } else if (name == "android.permission.RECORD_AUDIO")
+                            } else if (name == PERMISSION_RECORD_AUDIO)
                             {
                                 hasRecordAudioPermission = true;
-                            } else if (name == "android.permission.ACCESS_WIFI_STATE" ||
-                                       name == "android.permission.CHANGE_WIFI_STATE" ||
-                                       name == "android.permission.CHANGE_WIFI_MULTICAST_STATE")
+                            } else if (name == PERMISSION_ACCESS_WIFI_STATE ||
+                                       name == PERMISSION_CHANGE_WIFI_STATE ||
+                                       name == PERMISSION_CHANGE_WIFI_MULTICAST_STATE)
                             {
                                 hasWiFiPermission = true;
-                            } else if (name == "android.permission.CALL_PHONE" ||
-                                       name == "android.permission.CALL_PRIVILEGED" ||
-                                       name == "android.permission.MODIFY_PHONE_STATE" ||
-                                       name == "android.permission.PROCESS_OUTGOING_CALLS" ||
-                                       name == "android.permission.READ_SMS" ||
-                                       name == "android.permission.RECEIVE_SMS" ||
-                                       name == "android.permission.RECEIVE_MMS" ||
-                                       name == "android.permission.RECEIVE_WAP_PUSH" ||
-                                       name == "android.permission.SEND_SMS" ||
-                                       name == "android.permission.WRITE_APN_SETTINGS" ||
-                                       name == "android.permission.WRITE_SMS")
+                            } else if (name == PERMISSION_CALL_PHONE ||
+                                       name == PERMISSION_CALL_PRIVILEGED ||
+                                       name == PERMISSION_MODIFY_PHONE_STATE ||
+                                       name == PERMISSION_PROCESS_OUTGOING_CALLS ||
+                                       name == PERMISSION_READ_SMS ||
+                                       name == PERMISSION_RECEIVE_SMS ||
+                                       name == PERMISSION_RECEIVE_MMS ||
+                                       name == PERMISSION_RECEIVE_WAP_PUSH ||
+                                       name == PERMISSION_SEND_SMS ||
+                                       name == PERMISSION_WRITE_APN_SETTINGS ||
+                                       name == PERMISSION_WRITE_SMS)
                             {
                                 hasTelephonyPermission = true;
                             }
-                            writeString("uses-permission:'%s'\n", name.string());
-                        } else
-                        {
-                            goto bail;
-                        }
-                    } else if (tag == "uses-package")
-                    {
-                        String8 name = getAttribute(tree, NAME_ATTR, &error);
-                        if (name != "" && error == "")
-                        {
-                            writeString("uses-package:'%s'\n", name.string());
+                            writeString("uses-permission:'%s'\n", atoms.string(name));
                         } else
                         {
                             goto bail;
                         }
-                    } else if (tag == "original-package")
-                    {
-                        String8 name = getAttribute(tree, NAME_ATTR, &error);
-                        if (name != "" && error == "")
-                        {
-                            writeString("original-package:'%s'\n", name.string());
-                        } else
-                        {
-                            goto bail;
-                        }
-                    } else if (tag == "supports-gl-texture")
-                    {
-                        String8 name = getAttribute(tree, NAME_ATTR, &error);
-                        if (name != "" && error == "")
-                        {
-                            writeString("supports-gl-texture:'%s'\n", name.string());
-                        } else
-                        {
-                            goto bail;
-                        }
-                    } else if (tag == "compatible-screens")
+                        break;
+                    }
+                    case TAG_COMPATIBLE_SCREENS:
                     {
+                        // this consumes the element's events, up to and
+                        // including its end tag
                         printCompatibleScreens(tree);
+                        fields.feed(tree, ResXMLTree::END_TAG);
                         depth--;
-                    } else if (tag == "package-verifier")
+                        break;
+                    }
+                    case TAG_PACKAGE_VERIFIER:
                     {
                         String8 name = getAttribute(tree, NAME_ATTR, &error);
                         if (name != "" && error == "")
@@ -798,6 +1178,8 @@ int doDump(const char * filename)
                                        name.string(), publicKey.string());
                             }
                         }
+                        break;
+                    }
                     }
                 } else if (depth == 3 && withinApplication)
                 {
@@ -805,7 +1187,9 @@ int doDump(const char * filename)
                     withinReceiver = false;
                     withinService = false;
                     hasIntentFilter = false;
-                    if (tag == "activity")
+                    switch (tag)
+                    {
+                    case TAG_ACTIVITY:
                     {
                         withinActivity = true;
                         activityName = getAttribute(tree, NAME_ATTR, &error);
@@ -841,7 +1225,9 @@ int doDump(const char * filename)
                                 reqScreenPortraitFeature = true;
                             }
                         }
-                    } else if (tag == "uses-library")
+                        break;
+                    }
+                    case TAG_USES_LIBRARY:
                     {
                         String8 libraryName = getAttribute(tree, NAME_ATTR, &error);
                         if (error != "")
@@ -852,7 +1238,9 @@ int doDump(const char * filename)
                                                       REQUIRED_ATTR, NULL, 1);
                         writeString("uses-library%s:'%s'\n",
                                req ? "" : "-not-required", libraryName.string());
-                    } else if (tag == "receiver")
+                        break;
+                    }
+                    case TAG_RECEIVER:
                     {
                         withinReceiver = true;
                         receiverName = getAttribute(tree, NAME_ATTR, &error);
@@ -861,7 +1249,9 @@ int doDump(const char * filename)
                         {
                             goto bail;
                         }
-                    } else if (tag == "service")
+                        break;
+                    }
+                    case TAG_SERVICE:
                     {
                         withinService = true;
                         serviceName = getAttribute(tree, NAME_ATTR, &error);
@@ -870,65 +1260,71 @@ int doDump(const char * filename)
                         {
                             goto bail;
                         }
+                        break;
+                    }
                     }
-                } else if ((depth == 4) && (tag == "intent-filter"))
+                } else if ((depth == 4) && (tag == TAG_INTENT_FILTER))
                 {
                     hasIntentFilter = true;
                     withinIntentFilter = true;
                     actMainActivity = actWidgetReceivers = actImeService = actWallpaperService = false;
                 } else if ((depth == 5) && withinIntentFilter)
                 {
-                    String8 action;
-                    if (tag == "action")
+                    uint32_t action = StringInterner::NO_ATOM;
+                    switch (tag)
+                    {
+                    case TAG_ACTION:
                     {
-                        action = getAttribute(tree, NAME_ATTR, &error);
+                        action = getAttributeAtom(atoms, tree, NAME_ATTR, &error);
                         if (error != "")
                         {
                             goto bail;
                         }
                         if (withinActivity)
                         {
-                            if (action == "android.intent.action.MAIN")
+                            if (action == ACTION_MAIN)
                             {
                                 isMainActivity = true;
                                 actMainActivity = true;
                             }
                         } else if (withinReceiver)
                         {
-                            if (action == "android.appwidget.action.APPWIDGET_UPDATE")
+                            if (action == ACTION_APPWIDGET_UPDATE)
                             {
                                 actWidgetReceivers = true;
                             }
                         } else if (withinService)
                         {
-                            if (action == "android.view.InputMethod")
+                            if (action == ACTION_INPUT_METHOD)
                             {
                                 actImeService = true;
-                            } else if (action == "android.service.wallpaper.WallpaperService")
+                            } else if (action == ACTION_WALLPAPER_SERVICE)
                             {
                                 actWallpaperService = true;
                             }
                         }
-                        if (action == "android.intent.action.SEARCH")
+                        if (action == ACTION_SEARCH)
                         {
                             isSearchable = true;
                         }
+                        break;
                     }
-
-                    if (tag == "category")
+                    case TAG_CATEGORY:
                     {
-                        String8 category = getAttribute(tree, NAME_ATTR, &error);
+                        uint32_t category = getAttributeAtom(atoms, tree, NAME_ATTR, &error);
                         if (error != "")
                         {
                             goto bail;
                         }
                         if (withinActivity)
                         {
-                            if (category == "android.intent.category.LAUNCHER")
+                            if (category == CATEGORY_LAUNCHER)
                             {
                                 isLauncherActivity = true;
                             }
                         }
+                        break;
+                    }
                     }
                 }
             }
@@ -1203,9 +1599,344 @@ int doDump(const char * filename)
     result = 1;
 
     bail:
-    if (asset)
+    return result;
+}
+
+/*
+ * What doIdentity() prints; callers pass the ones they need.
+ */
+enum {
+    IDENTITY_PACKAGE        = 0x0001,   // package name, versionCode, versionName
+    IDENTITY_SDK            = 0x0002,   // sdkVersion, targetSdkVersion
+    IDENTITY_LAUNCHABLE     = 0x0004,   // the first launchable activity
+    IDENTITY_ALL            = 0x0007
+};
+
+/*
+ * The resource table, loaded the first time a value turns out to be a
+ * reference.  Manifests whose identity is all plain strings never read
+ * resources.arsc at all.
+ */
+struct LazyResTable {
+    LazyResTable(AssetManager& _assets) : assets(_assets), table(NULL) { }
+
+    const ResTable* get()
     {
-        delete asset;
+        if (table == NULL) {
+            table = &assets.getResources(false);
+        }
+        return table;
+    }
+
+    AssetManager&   assets;
+    const ResTable* table;
+};
+
+/*
+ * An attribute value captured while its element is current, to be turned
+ * into text later only if it is actually printed.
+ */
+struct deferred_value {
+    bool        present;
+    int32_t     stringId;
+    Res_value   value;
+};
+
+static void deferAttributeAt(const ResXMLTree& tree, ssize_t idx, deferred_value* out)
+{
+    out->present = idx >= 0 && tree.getAttributeValue(idx, &out->value) >= 0;
+    out->stringId = out->present ? tree.getAttributeValueStringID(idx) : -1;
+}
+
+static String8 resolveDeferred(LazyResTable& res, const ResXMLTree& tree,
+                               const deferred_value& v, String8* outError)
+{
+    if (!v.present) {
+        return String8();
+    }
+    if (v.stringId >= 0) {
+        return tree.getStrings().string8ObjectAt(v.stringId);
+    }
+    Res_value value = v.value;
+    if (value.dataType == Res_value::TYPE_REFERENCE
+        || value.dataType == Res_value::TYPE_ATTRIBUTE) {
+        const ResTable* table = res.get();
+        ssize_t block = table->resolveReference(&value, 0);
+        if (block >= 0 && value.dataType == Res_value::TYPE_STRING) {
+            const ResStringPool* pool = table->getTableStringBlock(block);
+            return pool ? pool->string8ObjectAt(value.data) : String8();
+        }
+    }
+    if (outError != NULL) *outError = "attribute is not a string value";
+    return String8();
+}
+
+/*
+ * Prints the subset of the badging output selected by 'fields', in the
+ * same format.  The manifest is walked once, without an index, and the
+ * walk stops as soon as everything asked for has been printed; the
+ * resource table is only loaded if one of the printed values is a
+ * reference.  Locales, densities and the rest of the badging output are
+ * never computed.
+ */
+int doIdentity(const char * filename, uint32_t fields)
+{
+    int result = 0;
+    sp<AssetData> manifest;
+    ResXMLTree tree;
+
+    AssetManager assets;
+    assets.setAnalysisMode(true);
+    StringInterner atoms;
+    internKnownAtoms(atoms);
+    void *assetsCookie;
+    if (!assets.addAssetPath(String8(filename), &assetsCookie))
+    {
+        return 1;
+    }
+
+    ResTable_config config;
+    config.language[0] = 'e';
+    config.language[1] = 'n';
+    config.country[0] = 'U';
+    config.country[1] = 'S';
+    config.orientation = ResTable_config::ORIENTATION_PORT;
+    config.density = ResTable_config::DENSITY_MEDIUM;
+    config.sdkVersion = 10000; // Very high.
+    config.screenWidthDp = 320;
+    config.screenHeightDp = 480;
+    config.smallestScreenWidthDp = 320;
+    assets.setConfiguration(config);
+
+    LazyResTable res(assets);
+    manifest = AssetData::create(
+            assets.openNonAsset("AndroidManifest.xml", Asset::ACCESS_BUFFER));
+    if (manifest == NULL || tree.setTo(manifest) != NO_ERROR)
+    {
+        goto bail;
+    }
+    if (tree.setElementCodes(kKnownAtoms + TAG_MANIFEST, NUM_TAGS) != NO_ERROR)
+    {
+        goto bail;
+    }
+
+    {
+        ResXMLTree::event_code_t code;
+        int depth = 0;
+        uint32_t needed = fields & IDENTITY_ALL;
+        String8 error;
+        String8 pkg;
+        bool withinApplication = false;
+        bool withinActivity = false;
+        bool withinIntentFilter = false;
+        bool isMainActivity = false;
+        bool isLauncherActivity = false;
+        deferred_value activityName;
+        deferred_value activityLabel;
+        deferred_value activityIcon;
+
+        tree.restart();
+        while (needed != 0 && (code = tree.next()) != ResXMLTree::END_DOCUMENT &&
+               code != ResXMLTree::BAD_DOCUMENT)
+        {
+            if (code == ResXMLTree::END_TAG)
+            {
+                depth--;
+                if (depth < 2)
+                {
+                    withinApplication = false;
+                } else if (depth < 3)
+                {
+                    if (withinActivity && isMainActivity && isLauncherActivity)
+                    {
+                        String8 name = resolveDeferred(res, tree, activityName, NULL);
+                        String8 label = resolveDeferred(res, tree, activityLabel, NULL);
+                        String8 icon = resolveDeferred(res, tree, activityIcon, NULL);
+                        ssize_t dot = name.find(".");
+                        if (dot <= 0)
+                        {
+                            String8 full(pkg);
+                            if (dot < 0)
+                            {
+                                full += ".";
+                            }
+                            full += name;
+                            name = full;
+                        }
+                        writeString("launchable-activity: name='%s'  label='%s' icon='%s'\n",
+                               name.string(), label.string(), icon.string());
+                        needed &= ~IDENTITY_LAUNCHABLE;
+                    }
+                    withinActivity = false;
+                    isMainActivity = isLauncherActivity = false;
+                } else if (depth < 4)
+                {
+                    withinIntentFilter = false;
+                }
+                continue;
+            }
+            if (code != ResXMLTree::START_TAG)
+            {
+                continue;
+            }
+            depth++;
+            const uint32_t tag = tree.getElementCode();
+            if (depth == 1)
+            {
+                if (tag != TAG_MANIFEST)
+                {
+                    goto bail;
+                }
+                pkg = getAttribute(tree, NULL, "package", NULL);
+                if ((needed & IDENTITY_PACKAGE) == 0)
+                {
+                    continue;
+                }
+                writeString("package: name='%s' ", pkg.string());
+                int32_t versionCode = getIntegerAttribute(tree, VERSION_CODE_ATTR, &error);
+                if (error != "")
+                {
+                    goto bail;
+                }
+                if (versionCode > 0)
+                {
+                    writeString("versionCode='%d' ", versionCode);
+                } else
+                {
+                    writeString("versionCode='' ");
+                }
+                deferred_value versionName;
+                deferAttributeAt(tree, indexOfAttribute(tree, VERSION_NAME_ATTR), &versionName);
+                String8 name = resolveDeferred(res, tree, versionName, &error);
+                if (error != "")
+                {
+                    goto bail;
+                }
+                writeString("versionName='%s'\n", name.string());
+                needed &= ~IDENTITY_PACKAGE;
+            } else if (depth == 2)
+            {
+                withinApplication = tag == TAG_APPLICATION;
+                if (tag == TAG_USES_SDK && (needed & IDENTITY_SDK) != 0)
+                {
+                    ssize_t idx[NUM_SDK_ATTRS];
+                    tree.gatherAttributes(kUsesSdkAttrs, NUM_SDK_ATTRS, idx);
+                    static const struct {
+                        int slot;
+                        const char* label;
+                    } kSdkFields[] = {
+                        { SDK_MIN, "sdkVersion" },
+                        { SDK_TARGET, "targetSdkVersion" },
+                    };
+                    for (size_t i = 0; i < sizeof(kSdkFields)/sizeof(kSdkFields[0]); i++)
+                    {
+                        const ssize_t at = idx[kSdkFields[i].slot];
+                        int32_t version = getIntegerAttributeAt(tree, at, &error);
+                        if (error != "")
+                        {
+                            error = "";
+                            deferred_value v;
+                            deferAttributeAt(tree, at, &v);
+                            String8 name = resolveDeferred(res, tree, v, &error);
+                            if (error != "")
+                            {
+                                goto bail;
+                            }
+                            writeString("%s:'%s'\n", kSdkFields[i].label, name.string());
+                        } else if (version != -1)
+                        {
+                            writeString("%s:'%d'\n", kSdkFields[i].label, version);
+                        }
+                    }
+                    needed &= ~IDENTITY_SDK;
+                }
+            } else if (depth == 3 && withinApplication)
+            {
+                withinActivity = tag == TAG_ACTIVITY && (needed & IDENTITY_LAUNCHABLE) != 0;
+                if (withinActivity)
+                {
+                    // Only captured here; resolving waits until the
+                    // activity is known to be launchable.
+                    deferAttributeAt(tree, indexOfAttribute(tree, NAME_ATTR), &activityName);
+                    deferAttributeAt(tree, indexOfAttribute(tree, LABEL_ATTR), &activityLabel);
+                    deferAttributeAt(tree, indexOfAttribute(tree, ICON_ATTR), &activityIcon);
+                }
+            } else if (depth == 4 && withinActivity)
+            {
+                withinIntentFilter = tag == TAG_INTENT_FILTER;
+            } else if (depth == 5 && withinIntentFilter)
+            {
+                if (tag == TAG_ACTION)
+                {
+                    if (getAttributeAtom(atoms, tree, NAME_ATTR, NULL) == ACTION_MAIN)
+                    {
+                        isMainActivity = true;
+                    }
+                } else if (tag == TAG_CATEGORY)
+                {
+                    if (getAttributeAtom(atoms, tree, NAME_ATTR, NULL) == CATEGORY_LAUNCHER)
+                    {
+                        isLauncherActivity = true;
+                    }
+                }
+            }
+        }
+    }
+
+    result = 1;
+
+    bail:
+    return result;
+}
+
+/*
+ * Decompiles one binary XML entry of the package (the manifest or a
+ * res/xml file) into g_ReturnString.  The first pass only measures, so
+ * the text is written once, straight into its final buffer.
+ */
+int doXmlTree(const char * filename, const char * entry)
+{
+    int result = 0;
+    ResXMLTree tree;
+    size_t len;
+
+    AssetManager assets;
+    assets.setAnalysisMode(true);
+    void *assetsCookie;
+    if (!assets.addAssetPath(String8(filename), &assetsCookie))
+    {
+        return 1;
+    }
+
+    if (tree.setTo(AssetData::create(assets.openNonAsset(entry, Asset::ACCESS_BUFFER)))
+            != NO_ERROR)
+    {
+        goto bail;
+    }
+
+    {
+        ResXMLWriter measure(NULL, 0);
+        if (measure.write(tree) != NO_ERROR)
+        {
+            goto bail;
+        }
+        len = measure.getLength();
+    }
+    g_ReturnString.resize(len);
+    {
+        ResXMLWriter writer(&g_ReturnString[0], len+1);
+        if (writer.write(tree) != NO_ERROR)
+        {
+            goto bail;
+        }
+    }
+
+    result = 1;
+
+    bail:
+    if (result == 0)
+    {
+        g_ReturnString.clear();
     }
     return result;
 }
@@ -1224,3 +1955,35 @@ Java_com_kappa_aapt_MainActivity_getApkInfo(
     env->ReleaseStringUTFChars(path,csPath);
     return env->NewStringUTF(g_ReturnString.c_str());
 }
+
+extern "C"
+jstring
+Java_com_kappa_aapt_MainActivity_getApkIdentity(
+        JNIEnv *env,
+        jobject obj,
+        jstring path,
+        jint fields)
+{
+    const char * csPath = env->GetStringUTFChars(path,0);
+    g_ReturnString.clear();
+    doIdentity(csPath, (uint32_t)fields);
+    env->ReleaseStringUTFChars(path,csPath);
+    return env->NewStringUTF(g_ReturnString.c_str());
+}
+
+extern "C"
+jstring
+Java_com_kappa_aapt_MainActivity_getXmlTree(
+        JNIEnv *env,
+        jobject obj,
+        jstring path,
+        jstring entry)
+{
+    const char * csPath = env->GetStringUTFChars(path,0);
+    const char * csEntry = env->GetStringUTFChars(entry,0);
+    g_ReturnString.clear();
+    doXmlTree(csPath, csEntry);
+    env->ReleaseStringUTFChars(entry,csEntry);
+    env->ReleaseStringUTFChars(path,csPath);
+    return env->NewStringUTF(g_ReturnString.c_str());
+}
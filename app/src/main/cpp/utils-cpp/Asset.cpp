@@ -156,6 +156,30 @@ Asset::~Asset(void)
 #endif
 
     pAsset = new _FileAsset;
+
+    /*
+     * If the caller is going to want the whole thing, map it right away
+     * instead of holding a FILE* and copying it into a buffer later.  The
+     * mapping survives closing the fd.
+     */
+    if (mode != ACCESS_STREAMING && length >= _FileAsset::kReadVsMapThreshold) {
+        FileMap* map = new FileMap;
+        if (map->create(fileName, fd, 0, length, true)) {
+            ::close(fd);
+            result = pAsset->openChunk(map);
+            if (result != NO_ERROR) {
+                map->release();
+                delete pAsset;
+                return NULL;
+            }
+
+            pAsset->mAccessMode = mode;
+            return pAsset;
+        }
+        map->release();
+        /* fall back to stdio */
+    }
+
     result = pAsset->openChunk(fileName, fd, 0, length);
     if (result != NO_ERROR) {
         delete pAsset;
@@ -176,7 +200,70 @@ Asset::~Asset(void)
 /*static*/ Asset* Asset::createFromCompressedFile(const char* fileName,
     AccessMode mode)
 {
-    return NULL;
+    _CompressedAsset* pAsset;
+    status_t result;
+    off64_t fileLen;
+    bool scanResult;
+    long offset;
+    int method;
+    long uncompressedLen, compressedLen;
+    unsigned long crc32;
+    int fd;
+
+    fd = open(fileName, O_RDONLY | O_BINARY);
+    if (fd < 0)
+        return NULL;
+
+    fileLen = lseek(fd, 0, SEEK_END);
+    if (fileLen < 0) {
+        ::close(fd);
+        return NULL;
+    }
+    (void) lseek(fd, 0, SEEK_SET);
+
+    /* want buffered I/O for the file scan; must dup so fclose() is safe */
+    FILE* fp = fdopen(dup(fd), "rb");
+    if (fp == NULL) {
+        ::close(fd);
+        return NULL;
+    }
+
+    scanResult = ZipUtils::examineGzip(fp, &method, &uncompressedLen,
+                    &compressedLen, &crc32);
+    offset = ftell(fp);
+    fclose(fp);
+    if (!scanResult || compressedLen <= 0 || offset + compressedLen > fileLen) {
+        LOGD("File '%s' is not in gzip format\n", fileName);
+        ::close(fd);
+        return NULL;
+    }
+
+    pAsset = new _CompressedAsset;
+
+    /*
+     * Map the deflated payload so it is inflated straight out of the page
+     * cache, the same way we handle compressed Zip entries.
+     */
+    FileMap* map = new FileMap;
+    if (map->create(fileName, fd, offset, compressedLen, true)) {
+        ::close(fd);
+        result = pAsset->openChunk(map, method, uncompressedLen);
+        if (result != NO_ERROR)
+            map->release();
+    } else {
+        map->release();
+        result = pAsset->openChunk(fd, offset, method, uncompressedLen,
+                    compressedLen);
+        if (result != NO_ERROR)
+            ::close(fd);
+    }
+    if (result != NO_ERROR) {
+        delete pAsset;
+        return NULL;
+    }
+
+    pAsset->mAccessMode = mode;
+    return pAsset;
 }
 
 
@@ -295,6 +382,37 @@ off64_t Asset::handleSeek(off64_t offset, int whence, off64_t curPosn, off64_t m
 }
 
 
+/*
+ * ===========================================================================
+ *      AssetData
+ * ===========================================================================
+ */
+
+/*static*/ sp<AssetData> AssetData::create(Asset* asset)
+{
+    if (asset == NULL) {
+        return NULL;
+    }
+    const void* data = asset->getBuffer(true);
+    if (data == NULL) {
+        LOGW("Unable to get buffer of asset %s\n", asset->getAssetSource());
+        delete asset;
+        return NULL;
+    }
+    return new AssetData(asset, data, (size_t)asset->getLength());
+}
+
+AssetData::AssetData(Asset* asset, const void* data, size_t size)
+    : mAsset(asset), mData(data), mSize(size)
+{
+}
+
+AssetData::~AssetData(void)
+{
+    delete mAsset;
+}
+
+
 /*
  * ===========================================================================
  *      _FileAsset
@@ -641,9 +759,37 @@ _CompressedAsset::~_CompressedAsset(void)
     close();
 }
 
+/*
+ * Open a chunk of compressed data inside a file.
+ *
+ * This currently just sets up some values and returns.  On the first
+ * read, we expand the entire file into a buffer and return data from it.
+ */
 status_t _CompressedAsset::openChunk(int fd, off64_t offset,
     int compressionMethod, size_t uncompressedLen, size_t compressedLen)
 {
+    assert(mFd < 0);        // no re-open
+    assert(mMap == NULL);
+    assert(fd >= 0);
+    assert(offset >= 0);
+    assert(compressedLen > 0);
+
+    if (compressionMethod != ZipFileRO::kCompressDeflated) {
+        assert(false);
+        return UNKNOWN_ERROR;
+    }
+
+    mStart = offset;
+    mCompressedLen = compressedLen;
+    mUncompressedLen = uncompressedLen;
+    assert(mOffset == 0);
+    mFd = fd;
+    assert(mBuf == NULL);
+
+    if (uncompressedLen > StreamingZipInflater::OUTPUT_CHUNK_SIZE) {
+        mZipInflater = new StreamingZipInflater(mFd, offset, uncompressedLen, compressedLen);
+    }
+
     return NO_ERROR;
 }
 
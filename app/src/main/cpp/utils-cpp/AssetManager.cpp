@@ -39,6 +39,7 @@
 #include <fcntl.h>
 #include <sys/stat.h>
 #include <unistd.h>
+#include <pthread.h>
 
 #ifndef TEMP_FAILURE_RETRY
 /* Used to retry syscalls that can return EINTR. */
@@ -68,6 +69,12 @@ static const char* kExcludeExtension = ".EXCLUDE";
 static Asset* const kExcludedAsset = (Asset*) 0xd000000d;
 
 static volatile int32_t gCount = 0;
+static volatile int32_t gReleasePagesOnClose = 0;
+
+/*
+ * Streamed Zip entries bigger than this get MADV_SEQUENTIAL.
+ */
+static const size_t kSequentialMin = 32768;
 
 namespace {
     // Transform string /a/b/c.apk to /data/resource-cache/a@b@c.apk@idmap
@@ -110,10 +117,15 @@ int32_t AssetManager::getGlobalCount()
     return gCount;
 }
 
+/*static*/ void AssetManager::setReleasePagesOnClose(bool release)
+{
+    gReleasePagesOnClose = release ? 1 : 0;
+}
+
 AssetManager::AssetManager(CacheMode cacheMode)
-    : mLocale(NULL), mVendor(NULL),
+    : mAnalysisMode(false), mLocale(NULL), mVendor(NULL),
       mResources(NULL), mConfig(new ResTable_config),
-      mCacheMode(cacheMode), mCacheValid(false)
+      mCacheMode(cacheMode), mCacheStale(FileNameCache::kDimAll)
 {
     int count = android_atomic_inc(&gCount)+1;
     memset(mConfig, 0, sizeof(ResTable_config));
@@ -176,7 +188,7 @@ bool AssetManager::addAssetPath(const String8& path, void** cookie)
 
     // add overlay packages for /system/framework; apps are handled by the
     // (Java) package manager
-    if (strncmp(path.string(), "/system/framework/", 18) == 0) {
+    if (!mAnalysisMode && strncmp(path.string(), "/system/framework/", 18) == 0) {
         // When there is an environment variable for /vendor, this
         // should be changed to something similar to how ANDROID_ROOT
         // and ANDROID_DATA are used in this file.
@@ -205,6 +217,76 @@ bool AssetManager::addAssetPath(const String8& path, void** cookie)
     return true;
 }
 
+bool AssetManager::addOverlayPath(const String8& overlayPath, void* targetCookie,
+    void** cookie)
+{
+    const size_t which = ((size_t)targetCookie)-1;
+
+    AutoMutex _l(mLock);
+
+    if (which >= mAssetPaths.size()) {
+        LOGW("No target asset path for overlay %s\n", overlayPath.string());
+        return false;
+    }
+    // copy; mAssetPaths may grow below
+    const String8 targetPath(mAssetPaths.itemAt(which).path);
+    if (mAssetPaths.itemAt(which).type != kFileTypeRegular) {
+        LOGW("Overlay target %s is not a package\n", targetPath.string());
+        return false;
+    }
+
+    asset_path oap;
+    oap.path = overlayPath;
+    oap.type = ::getFileType(overlayPath.string());
+    if (oap.type != kFileTypeRegular) { // only .apks supported as overlay
+        LOGW("Overlay path %s is not a package (type=%d).",
+             overlayPath.string(), (int)oap.type);
+        return false;
+    }
+    oap.idmapTarget = targetPath;
+
+    // Skip if we have it already.
+    for (size_t i=0; i<mAssetPaths.size(); i++) {
+        if (mAssetPaths[i].path == oap.path) {
+            if (cookie) {
+                *cookie = (void*)(i+1);
+            }
+            return true;
+        }
+    }
+
+    size_t idmapSize;
+    if (mZipSet.getZipIdmap(oap.path, targetPath, &idmapSize) == NULL) {
+        void* data = NULL;
+        size_t size = 0;
+        if (!createIdmapLocked(targetPath, oap.path, &data, &size)) {
+            LOGW("failed to add overlay package %s\n", overlayPath.string());
+            return false;
+        }
+        mZipSet.setZipIdmap(oap.path, targetPath, data, size, &idmapSize);
+    }
+
+    LOGV("In %p Asset overlay path: %s onto %s", this, oap.path.string(),
+         targetPath.string());
+
+    mAssetPaths.add(oap);
+
+    if (cookie) {
+        *cookie = (void*)mAssetPaths.size();
+    }
+
+    return true;
+}
+
+void AssetManager::setAnalysisMode(bool analysisMode)
+{
+    AutoMutex _l(mLock);
+
+    LOG_FATAL_IF(mAssetPaths.size() != 0,
+                 "Analysis mode must be chosen before adding asset paths");
+    mAnalysisMode = analysisMode;
+}
+
 bool AssetManager::isIdmapStaleLocked(const String8& originalPath, const String8& overlayPath,
                                       const String8& idmapPath)
 {
@@ -277,44 +359,68 @@ bool AssetManager::getZipEntryCrcLocked(const String8& zipPath, const char* entr
     return true;
 }
 
-bool AssetManager::createIdmapFileLocked(const String8& originalPath, const String8& overlayPath,
-                                         const String8& idmapPath)
+/*
+ * Build the idmap of "overlayPath" onto "originalPath".  On success the
+ * caller owns "*outData" and must free() it.
+ */
+bool AssetManager::createIdmapLocked(const String8& originalPath, const String8& overlayPath,
+                                     void** outData, size_t* outSize)
 {
-    LOGD("%s: originalPath=%s overlayPath=%s idmapPath=%s\n",
-         __FUNCTION__, originalPath.string(), overlayPath.string(), idmapPath.string());
     ResTable tables[2];
     const String8* paths[2] = { &originalPath, &overlayPath };
+    Asset* assets[2] = { NULL, NULL };
     uint32_t originalCrc, overlayCrc;
     bool retval = false;
-    ssize_t offset = 0;
-    int fd = 0;
-    uint32_t* data = NULL;
-    size_t size;
 
     for (int i = 0; i < 2; ++i) {
         asset_path ap;
         ap.type = kFileTypeRegular;
         ap.path = *paths[i];
-        Asset* ass = openNonAssetInPathLocked("resources.arsc", Asset::ACCESS_BUFFER, ap);
-        if (ass == NULL) {
+        assets[i] = openNonAssetInPathLocked("resources.arsc", Asset::ACCESS_BUFFER, ap);
+        if (assets[i] == NULL) {
             LOGW("failed to find resources.arsc in %s\n", ap.path.string());
-            goto error;
+            goto bail;
         }
-        tables[i].add(ass, (void*)1, false);
+        tables[i].add(assets[i], (void*)1, false);
     }
 
     if (!getZipEntryCrcLocked(originalPath, "resources.arsc", &originalCrc)) {
         LOGW("failed to retrieve crc for resources.arsc in %s\n", originalPath.string());
-        goto error;
+        goto bail;
     }
     if (!getZipEntryCrcLocked(overlayPath, "resources.arsc", &overlayCrc)) {
         LOGW("failed to retrieve crc for resources.arsc in %s\n", overlayPath.string());
-        goto error;
+        goto bail;
     }
 
     if (tables[0].createIdmap(tables[1], originalCrc, overlayCrc,
-                              (void**)&data, &size) != NO_ERROR) {
-        LOGW("failed to generate idmap data for file %s\n", idmapPath.string());
+                              outData, outSize) != NO_ERROR) {
+        LOGW("failed to generate idmap data for %s\n", overlayPath.string());
+        goto bail;
+    }
+
+    retval = true;
+bail:
+    // the tables don't copy the data, so they go first
+    tables[0].uninit();
+    tables[1].uninit();
+    delete assets[0];
+    delete assets[1];
+    return retval;
+}
+
+bool AssetManager::createIdmapFileLocked(const String8& originalPath, const String8& overlayPath,
+                                         const String8& idmapPath)
+{
+    LOGD("%s: originalPath=%s overlayPath=%s idmapPath=%s\n",
+         __FUNCTION__, originalPath.string(), overlayPath.string(), idmapPath.string());
+    bool retval = false;
+    ssize_t offset = 0;
+    int fd = 0;
+    uint32_t* data = NULL;
+    size_t size;
+
+    if (!createIdmapLocked(originalPath, overlayPath, (void**)&data, &size)) {
         goto error;
     }
 
@@ -391,12 +497,16 @@ void AssetManager::setLocale(const char* locale)
 
 void AssetManager::setLocaleLocked(const char* locale)
 {
-    if (mLocale != NULL) {
-        /* previously set, purge cached data */
-        purgeFileNameCacheLocked();
-        //mZipSet.purgeLocale();
-        delete[] mLocale;
+    if (mLocale != NULL && locale != NULL && strcmp(mLocale, locale) == 0) {
+        /* unchanged, keep the cached data */
+        updateResourceParamsLocked();
+        return;
     }
+
+    /* drop the cached names that depend on the old locale */
+    invalidateFileNameCacheLocked(FileNameCache::kDimLocale);
+    //mZipSet.purgeLocale();
+    delete[] mLocale;
     mLocale = strdupNew(locale);
 
     updateResourceParamsLocked();
@@ -412,12 +522,14 @@ void AssetManager::setVendor(const char* vendor)
 {
     AutoMutex _l(mLock);
 
-    if (mVendor != NULL) {
-        /* previously set, purge cached data */
-        purgeFileNameCacheLocked();
-        //mZipSet.purgeVendor();
-        delete[] mVendor;
+    if (mVendor != NULL && vendor != NULL && strcmp(mVendor, vendor) == 0) {
+        return;
     }
+
+    /* drop the cached names that depend on the old vendor */
+    invalidateFileNameCacheLocked(FileNameCache::kDimVendor);
+    //mZipSet.purgeVendor();
+    delete[] mVendor;
     mVendor = strdupNew(vendor);
 }
 
@@ -482,7 +594,7 @@ Asset* AssetManager::open(const char* fileName, AccessMode mode)
     LOG_FATAL_IF(mAssetPaths.size() == 0, "No assets added to AssetManager");
 
 
-    if (mCacheMode != CACHE_OFF && !mCacheValid)
+    if (mCacheMode != CACHE_OFF && mCacheStale != 0)
         loadFileNameCacheLocked();
 
     String8 assetName(kAssetsRoot);
@@ -519,7 +631,7 @@ Asset* AssetManager::openNonAsset(const char* fileName, AccessMode mode)
     LOG_FATAL_IF(mAssetPaths.size() == 0, "No assets added to AssetManager");
 
 
-    if (mCacheMode != CACHE_OFF && !mCacheValid)
+    if (mCacheMode != CACHE_OFF && mCacheStale != 0)
         loadFileNameCacheLocked();
 
     /*
@@ -549,7 +661,7 @@ Asset* AssetManager::openNonAsset(void* cookie, const char* fileName, AccessMode
     LOG_FATAL_IF(mAssetPaths.size() == 0, "No assets added to AssetManager");
 
 
-    if (mCacheMode != CACHE_OFF && !mCacheValid)
+    if (mCacheMode != CACHE_OFF && mCacheStale != 0)
         loadFileNameCacheLocked();
 
     if (which < mAssetPaths.size()) {
@@ -565,6 +677,185 @@ Asset* AssetManager::openNonAsset(void* cookie, const char* fileName, AccessMode
     return NULL;
 }
 
+size_t AssetManager::openNonAssets(void* cookie, const char* const* fileNames,
+    size_t count, AccessMode mode, Asset** outAssets)
+{
+    const size_t which = ((size_t)cookie)-1;
+    size_t numOpened = 0;
+
+    AutoMutex _l(mLock);
+
+    LOG_FATAL_IF(mAssetPaths.size() == 0, "No assets added to AssetManager");
+
+    for (size_t i = 0; i < count; i++)
+        outAssets[i] = NULL;
+
+    if (which >= mAssetPaths.size())
+        return 0;
+
+    if (mCacheMode != CACHE_OFF && mCacheStale != 0)
+        loadFileNameCacheLocked();
+
+    const asset_path& ap = mAssetPaths.itemAt(which);
+    prefetchNonAssetsInPathLocked(fileNames, count, ap);
+
+    for (size_t i = 0; i < count; i++) {
+        LOGV("Looking for non-asset '%s' in '%s'\n", fileNames[i], ap.path.string());
+        Asset* pAsset = openNonAssetInPathLocked(fileNames[i], mode, ap);
+        if (pAsset == NULL || pAsset == kExcludedAsset)
+            continue;
+
+        /* the data is warm now, so expand it while it stays that way */
+        if (mode == Asset::ACCESS_BUFFER && pAsset->getBuffer(true) == NULL) {
+            LOGW("Unable to get buffer of '%s'\n", fileNames[i]);
+            delete pAsset;
+            continue;
+        }
+
+        outAssets[i] = pAsset;
+        numOpened++;
+    }
+
+    return numOpened;
+}
+
+void AssetManager::prefetchNonAssets(void* cookie, const char* const* fileNames,
+    size_t count)
+{
+    const size_t which = ((size_t)cookie)-1;
+
+    AutoMutex _l(mLock);
+
+    if (which < mAssetPaths.size())
+        prefetchNonAssetsInPathLocked(fileNames, count, mAssetPaths.itemAt(which));
+}
+
+/*
+ * Shared by the openXmlTrees() workers; each claims the next file by
+ * bumping "next".
+ */
+struct xml_work
+{
+    AssetManager::xml_file*     files;
+    int32_t                     count;
+    volatile int32_t            next;
+    volatile int32_t            parsed;
+    const ResTable*             res;
+    AssetManager::xml_visitor   visitor;
+    void*                       data;
+};
+
+static const size_t kMaxXmlThreads = 8;
+
+static void* parseXmlFiles(void* arg)
+{
+    xml_work* work = (xml_work*)arg;
+    int32_t i;
+    while ((i = android_atomic_inc(&work->next)) < work->count) {
+        AssetManager::xml_file& file = work->files[i];
+        if (file.asset == NULL) {
+            continue;
+        }
+        const void* buf = file.asset->getBuffer(true);
+        if (buf == NULL) {
+            LOGW("Unable to get buffer of '%s'\n", file.fileName);
+            file.error = NO_MEMORY;
+            continue;
+        }
+        file.tree = new ResXMLTree();
+        file.error = file.tree->setTo(buf, file.asset->getLength());
+        if (file.error == NO_ERROR && work->visitor != NULL) {
+            file.error = work->visitor(&file, *work->res, work->data);
+        }
+        if (file.error == NO_ERROR) {
+            android_atomic_inc(&work->parsed);
+        }
+    }
+    return NULL;
+}
+
+size_t AssetManager::openXmlTrees(void* cookie, const char* const* fileNames, size_t count,
+    xml_file* outFiles, xml_visitor visitor, void* data, size_t numThreads)
+{
+    const size_t which = ((size_t)cookie)-1;
+
+    for (size_t i = 0; i < count; i++) {
+        outFiles[i].fileName = fileNames[i];
+        outFiles[i].asset = NULL;
+        outFiles[i].tree = NULL;
+        outFiles[i].error = NAME_NOT_FOUND;
+    }
+
+    /*
+     * Opening only maps the entries; that part needs the lock.  The
+     * inflating and parsing are done by the workers.
+     */
+    {
+        AutoMutex _l(mLock);
+
+        LOG_FATAL_IF(mAssetPaths.size() == 0, "No assets added to AssetManager");
+        if (which >= mAssetPaths.size())
+            return 0;
+
+        if (mCacheMode != CACHE_OFF && mCacheStale != 0)
+            loadFileNameCacheLocked();
+
+        const asset_path& ap = mAssetPaths.itemAt(which);
+        prefetchNonAssetsInPathLocked(fileNames, count, ap);
+        for (size_t i = 0; i < count; i++) {
+            Asset* pAsset = openNonAssetInPathLocked(fileNames[i], Asset::ACCESS_BUFFER, ap);
+            if (pAsset == NULL || pAsset == kExcludedAsset)
+                continue;
+            outFiles[i].asset = pAsset;
+            outFiles[i].error = NO_ERROR;
+        }
+    }
+
+    // build the table now, not on a worker
+    const ResTable& res = getResources(false);
+
+    if (numThreads == 0) {
+        long cpus = sysconf(_SC_NPROCESSORS_ONLN);
+        numThreads = cpus > 1 ? (size_t)cpus : 1;
+    }
+    if (numThreads > kMaxXmlThreads)
+        numThreads = kMaxXmlThreads;
+    if (numThreads > count)
+        numThreads = count;
+
+    xml_work work;
+    work.files = outFiles;
+    work.count = (int32_t)count;
+    work.next = 0;
+    work.parsed = 0;
+    work.res = &res;
+    work.visitor = visitor;
+    work.data = data;
+
+    pthread_t threads[kMaxXmlThreads];
+    size_t started = 0;
+    for (size_t t = 1; t < numThreads; t++) {
+        if (pthread_create(&threads[started], NULL, parseXmlFiles, &work) != 0)
+            break;
+        started++;
+    }
+    parseXmlFiles(&work);
+    for (size_t t = 0; t < started; t++)
+        pthread_join(threads[t], NULL);
+
+    return work.parsed;
+}
+
+void AssetManager::closeXmlTrees(xml_file* files, size_t count)
+{
+    for (size_t i = 0; i < count; i++) {
+        delete files[i].tree;
+        files[i].tree = NULL;
+        delete files[i].asset;
+        files[i].asset = NULL;
+    }
+}
+
 /*
  * Get the type of a file in the asset namespace.
  *
@@ -608,7 +899,7 @@ const ResTable* AssetManager::getResTable(bool required) const
         LOG_FATAL_IF(mAssetPaths.size() == 0, "No assets added to AssetManager");
     }
 
-    if (mCacheMode != CACHE_OFF && !mCacheValid)
+    if (mCacheMode != CACHE_OFF && mCacheStale != 0)
         const_cast<AssetManager*>(this)->loadFileNameCacheLocked();
 
     const size_t N = mAssetPaths.size();
@@ -617,7 +908,19 @@ const ResTable* AssetManager::getResTable(bool required) const
         ResTable* sharedRes = NULL;
         bool shared = true;
         const asset_path& ap = mAssetPaths.itemAt(i);
-        Asset* idmap = openIdmapLocked(ap);
+        Asset* idmap = NULL;
+        const void* idmapData = NULL;
+        size_t idmapSize = 0;
+        if (ap.idmapTarget.size() != 0) {
+            idmapData = const_cast<AssetManager*>(this)->
+                mZipSet.getZipIdmap(ap.path, ap.idmapTarget, &idmapSize);
+        } else if (!mAnalysisMode) {
+            idmap = openIdmapLocked(ap);
+            if (idmap != NULL) {
+                idmapSize = idmap->getLength();
+                idmapData = idmap->getBuffer(true);
+            }
+        }
         LOGV("Looking for resource asset in '%s'\n", ap.path.string());
         if (ap.type != kFileTypeDirectory) {
             if (i == 0) {
@@ -647,14 +950,14 @@ const ResTable* AssetManager::getResTable(bool required) const
                     // can quickly copy it out for others.
                     LOGV("Creating shared resources for %s", ap.path.string());
                     sharedRes = new ResTable();
-                    sharedRes->add(ass, (void*)(i+1), false, idmap);
+                    sharedRes->add(ass, (void*)(i+1), idmapData, idmapSize, false);
                     sharedRes = const_cast<AssetManager*>(this)->
                         mZipSet.setZipResourceTable(ap.path, sharedRes);
                 }
             }
         } else {
             LOGV("loading resource table %s\n", ap.path.string());
-            Asset* ass = const_cast<AssetManager*>(this)->
+            ass = const_cast<AssetManager*>(this)->
                 openNonAssetInPathLocked("resources.arsc",
                                          Asset::ACCESS_BUFFER,
                                          ap);
@@ -671,7 +974,7 @@ const ResTable* AssetManager::getResTable(bool required) const
                 rt->add(sharedRes);
             } else {
                 LOGV("Parsing resources for %s", ap.path.string());
-                rt->add(ass, (void*)(i+1), !shared, idmap);
+                rt->add(ass, (void*)(i+1), idmapData, idmapSize, !shared);
             }
 
             if (!shared) {
@@ -809,6 +1112,30 @@ Asset* AssetManager::openNonAssetInPathLocked(const char* fileName, AccessMode m
     return pAsset;
 }
 
+/*
+ * Read the data for a set of non-asset files in one pass.  Loose files
+ * are left to the filesystem's own read-ahead.
+ */
+void AssetManager::prefetchNonAssetsInPathLocked(const char* const* fileNames,
+    size_t count, const asset_path& ap)
+{
+    if (ap.type == kFileTypeDirectory)
+        return;
+
+    ZipFileRO* pZip = getZipFileLocked(ap);
+    if (pZip == NULL)
+        return;
+
+    Vector<ZipEntryRO> entries;
+    for (size_t i = 0; i < count; i++) {
+        ZipEntryRO entry = pZip->findEntryByName(fileNames[i]);
+        if (entry != NULL)
+            entries.add(entry);
+    }
+
+    pZip->prefetchEntries(entries.array(), entries.size());
+}
+
 /*
  * Open an asset, searching for it in the directory hierarchy for the
  * specified app.
@@ -885,7 +1212,7 @@ Asset* AssetManager::openInLocaleVendorLocked(const char* fileName, AccessMode m
             String8 excludeName(path);
             excludeName.append(kExcludeExtension);
 
-            if (mCache.indexOf(excludeName) != NAME_NOT_FOUND) {
+            if (mCache.contains(excludeName.string(), excludeName.length())) {
                 /* go no farther */
                 //printf("+++ Excluding '%s'\n", (const char*) excludeName);
                 return kExcludedAsset;
@@ -895,7 +1222,7 @@ Asset* AssetManager::openInLocaleVendorLocked(const char* fileName, AccessMode m
              * File compression extensions (".gz") don't get stored in the
              * name cache, so we have to try both here.
              */
-            if (mCache.indexOf(path) != NAME_NOT_FOUND) {
+            if (mCache.contains(path.string(), path.length())) {
                 found = true;
                 pAsset = openAssetFromFileLocked(path, mode);
                 if (pAsset == NULL) {
@@ -1038,6 +1365,14 @@ Asset* AssetManager::openAssetFromFileLocked(const String8& pathName,
 {
     Asset* pAsset = NULL;
 
+    if (strcasecmp(pathName.getPathExtension().string(), ".gz") == 0) {
+        //printf("TRYING '%s'\n", (const char*) pathName);
+        pAsset = Asset::createFromCompressedFile(pathName.string(), mode);
+    } else {
+        //printf("TRYING '%s'\n", (const char*) pathName);
+        pAsset = Asset::createFromFile(pathName.string(), mode);
+    }
+
     return pAsset;
 }
 
@@ -1073,6 +1408,16 @@ Asset* AssetManager::openAssetFromZipLocked(const ZipFileRO* pZipFile,
         return NULL;
     }
 
+    /*
+     * Large entries that are going to be streamed through get a bigger
+     * read-ahead.  The map lives only as long as the Asset, so there's
+     * nothing to reset afterwards.
+     */
+    if (mode == Asset::ACCESS_STREAMING &&
+            dataMap->getDataLength() > kSequentialMin) {
+        dataMap->advise(FileMap::SEQUENTIAL);
+    }
+
     if (method == ZipFileRO::kCompressStored) {
         pAsset = Asset::createFromUncompressedMap(dataMap, mode);
         LOGV("Opened uncompressed entry %s in zip %s mode %d: %p", entryName.string(),
@@ -1114,7 +1459,7 @@ AssetDir* AssetManager::openDir(const char* dirName)
 
     //printf("+++ openDir(%s) in '%s'\n", dirName, (const char*) mAssetBase);
 
-    if (mCacheMode != CACHE_OFF && !mCacheValid)
+    if (mCacheMode != CACHE_OFF && mCacheStale != 0)
         loadFileNameCacheLocked();
 
     pDir = new AssetDir;
@@ -1177,7 +1522,7 @@ AssetDir* AssetManager::openNonAssetDir(void* cookie, const char* dirName)
 
     //printf("+++ openDir(%s) in '%s'\n", dirName, (const char*) mAssetBase);
 
-    if (mCacheMode != CACHE_OFF && !mCacheValid)
+    if (mCacheMode != CACHE_OFF && mCacheStale != 0)
         loadFileNameCacheLocked();
 
     pDir = new AssetDir;
@@ -1220,6 +1565,62 @@ AssetDir* AssetManager::openNonAssetDir(void* cookie, const char* dirName)
 bool AssetManager::scanAndMergeDirLocked(SortedVector<AssetDir::FileInfo>* pMergedInfo,
     const asset_path& ap, const char* rootDir, const char* dirName)
 {
+    SortedVector<AssetDir::FileInfo>* pContents;
+    String8 path;
+
+    assert(pMergedInfo != NULL);
+
+    /*
+     * The file name cache only answers "is this name present", so we
+     * always go to the filesystem for a directory listing.
+     */
+    path = createPathNameLocked(ap, rootDir);
+    if (dirName[0] != '\0')
+        path.appendPath(dirName);
+
+    pContents = scanDirLocked(path);
+    if (pContents == NULL)
+        return false;
+
+    /*
+     * Process "exclude" directives.  If we find a filename that ends with
+     * ".EXCLUDE", we look for a matching entry in the "merged" set, and
+     * remove it if we find it.  We also delete the "exclude" entry.
+     */
+    int i, count, exclExtLen;
+
+    count = pContents->size();
+    exclExtLen = strlen(kExcludeExtension);
+    for (i = 0; i < count; i++) {
+        const char* name;
+        int nameLen;
+
+        name = pContents->itemAt(i).getFileName().string();
+        nameLen = strlen(name);
+        if (nameLen > exclExtLen &&
+            strcmp(name + (nameLen - exclExtLen), kExcludeExtension) == 0)
+        {
+            String8 match(name, nameLen - exclExtLen);
+            ssize_t matchIdx;
+
+            matchIdx = pMergedInfo->indexOf(AssetDir::FileInfo(match));
+            if (matchIdx >= 0) {
+                LOGV("Excluding '%s' [%s]\n",
+                    pMergedInfo->itemAt(matchIdx).getFileName().string(),
+                    pMergedInfo->itemAt(matchIdx).getSourceName().string());
+                pMergedInfo->removeAt(matchIdx);
+            }
+
+            pContents->removeAt(i);
+            i--;        // adjust "for" loop
+            count--;    //  and loop limit
+        }
+    }
+
+    mergeInfoLocked(pMergedInfo, pContents);
+
+    delete pContents;
+
     return true;
 }
 
@@ -1502,7 +1903,7 @@ void AssetManager::mergeInfoLocked(SortedVector<AssetDir::FileInfo>* pMergedInfo
  * all combinations of { appname, locale, vendor }, performing a recursive
  * directory traversal.
  *
- * This is not the most efficient data structure.  Also, gathering the
+ * The names go into a FileNameCache, so lookups are cheap.  Gathering the
  * information as we needed it (file-by-file or directory-by-directory)
  * would be faster.  However, on the actual device, 99% of the files will
  * live in Zip archives, so this list will be very small.  The trouble
@@ -1511,20 +1912,20 @@ void AssetManager::mergeInfoLocked(SortedVector<AssetDir::FileInfo>* pMergedInfo
  * there.
  *
  * Note on thread safety: this is the only function that causes updates
- * to mCache, and anybody who tries to use it will call here if !mCacheValid,
+ * to mCache, and anybody who tries to use it will call here if mCacheStale
+ * is set,
  * so we need to employ a mutex here.
  */
 void AssetManager::loadFileNameCacheLocked(void)
 {
-    assert(!mCacheValid);
-    assert(mCache.size() == 0);
+    assert(mCacheStale != 0);
 
 #ifdef DO_TIMINGS   // need to link against -lrt for this now
     DurationTimer timer;
     timer.start();
 #endif
 
-    fncScanLocked(&mCache, "");
+    fncScanLocked("");
 
 #ifdef DO_TIMINGS
     timer.stop();
@@ -1532,36 +1933,36 @@ void AssetManager::loadFileNameCacheLocked(void)
         timer.durationUsecs() / 1000.0);
 #endif
 
-#if 0
-    int i;
-    printf("CACHED FILE LIST (%d entries):\n", mCache.size());
-    for (i = 0; i < (int) mCache.size(); i++) {
-        printf(" %d: (%d) '%s'\n", i,
-            mCache.itemAt(i).getFileType(),
-            (const char*) mCache.itemAt(i).getFileName());
-    }
-#endif
+    LOGV("Cached file list has %d entries\n", (int) mCache.size());
 
-    mCacheValid = true;
+    mCacheStale = 0;
 }
 
 /*
  * Scan up to 8 versions of the specified directory.
+ *
+ * Only the locale/vendor combinations touched by a stale dimension are
+ * rescanned; everything else is still in the cache from last time.
  */
-void AssetManager::fncScanLocked(SortedVector<AssetDir::FileInfo>* pMergedInfo,
-    const char* dirName)
+void AssetManager::fncScanLocked(const char* dirName)
 {
+    const uint32_t kDefault = FileNameCache::kDimDefault;
+    const uint32_t kLocale = kDefault | FileNameCache::kDimLocale;
+    const uint32_t kVendor = kDefault | FileNameCache::kDimVendor;
+    const uint32_t kBoth = kLocale | kVendor;
+
     size_t i = mAssetPaths.size();
     while (i > 0) {
         i--;
         const asset_path& ap = mAssetPaths.itemAt(i);
-        fncScanAndMergeDirLocked(pMergedInfo, ap, NULL, NULL, dirName);
-        if (mLocale != NULL)
-            fncScanAndMergeDirLocked(pMergedInfo, ap, mLocale, NULL, dirName);
-        if (mVendor != NULL)
-            fncScanAndMergeDirLocked(pMergedInfo, ap, NULL, mVendor, dirName);
-        if (mLocale != NULL && mVendor != NULL)
-            fncScanAndMergeDirLocked(pMergedInfo, ap, mLocale, mVendor, dirName);
+        if ((mCacheStale & kDefault) != 0)
+            fncScanAndMergeDirLocked(ap, NULL, NULL, dirName, kDefault);
+        if (mLocale != NULL && (mCacheStale & kLocale) != 0)
+            fncScanAndMergeDirLocked(ap, mLocale, NULL, dirName, kLocale);
+        if (mVendor != NULL && (mCacheStale & kVendor) != 0)
+            fncScanAndMergeDirLocked(ap, NULL, mVendor, dirName, kVendor);
+        if (mLocale != NULL && mVendor != NULL && (mCacheStale & kBoth) != 0)
+            fncScanAndMergeDirLocked(ap, mLocale, mVendor, dirName, kBoth);
     }
 }
 
@@ -1570,11 +1971,10 @@ void AssetManager::fncScanLocked(SortedVector<AssetDir::FileInfo>* pMergedInfo,
  *
  * This is similar to scanAndMergeDir, but we don't remove the .EXCLUDE
  * files, and we prepend the extended partial path to the filenames.
+ * Every name found is added to the cache tagged with "dims".
  */
-bool AssetManager::fncScanAndMergeDirLocked(
-    SortedVector<AssetDir::FileInfo>* pMergedInfo,
-    const asset_path& ap, const char* locale, const char* vendor,
-    const char* dirName)
+bool AssetManager::fncScanAndMergeDirLocked(const asset_path& ap,
+    const char* locale, const char* vendor, const char* dirName, uint32_t dims)
 {
     SortedVector<AssetDir::FileInfo>* pContents;
     String8 partialPath;
@@ -1595,15 +1995,15 @@ bool AssetManager::fncScanAndMergeDirLocked(
     }
 
     /*
-     * Scan all subdirectories of the current dir, merging what we find
-     * into "pMergedInfo".
+     * Scan all subdirectories of the current dir, adding what we find
+     * to the cache.
      */
     for (int i = 0; i < (int) pContents->size(); i++) {
         if (pContents->itemAt(i).getFileType() == kFileTypeDirectory) {
             String8 subdir(dirName);
             subdir.appendPath(pContents->itemAt(i).getFileName());
 
-            fncScanAndMergeDirLocked(pMergedInfo, ap, locale, vendor, subdir.string());
+            fncScanAndMergeDirLocked(ap, locale, vendor, subdir.string(), dims);
         }
     }
 
@@ -1612,36 +2012,215 @@ bool AssetManager::fncScanAndMergeDirLocked(
      * we're the root, add one now.
      */
     if (dirName[0] == '\0') {
-        AssetDir::FileInfo tmpInfo;
-
-        tmpInfo.set(String8(""), kFileTypeDirectory);
-        tmpInfo.setSourceName(createPathNameLocked(ap, locale, vendor));
-        pContents->add(tmpInfo);
+        mCache.add(partialPath.string(), partialPath.length(), dims);
     }
 
     /*
-     * We want to prepend the extended partial path to every entry in
-     * "pContents".  It's the same value for each entry, so this will
-     * not change the sorting order of the vector contents.
+     * Add the extended partial path of every entry in "pContents".
      */
     for (int i = 0; i < (int) pContents->size(); i++) {
         const AssetDir::FileInfo& info = pContents->itemAt(i);
-        pContents->editItemAt(i).setFileName(partialPath.appendPathCopy(info.getFileName()));
+        String8 name(partialPath.appendPathCopy(info.getFileName()));
+        mCache.add(name.string(), name.length(), dims);
     }
 
-    mergeInfoLocked(pMergedInfo, pContents);
+    delete pContents;
     return true;
 }
 
+/*
+ * Discard the cached names that depend on the locale and/or vendor
+ * named by "dims", and arrange for them to be rescanned on next use.
+ */
+void AssetManager::invalidateFileNameCacheLocked(uint32_t dims)
+{
+    mCache.purge(dims);
+    mCacheStale |= dims;
+}
+
 /*
  * Trash the cache.
  */
 void AssetManager::purgeFileNameCacheLocked(void)
 {
-    mCacheValid = false;
+    mCacheStale = FileNameCache::kDimAll;
     mCache.clear();
 }
 
+/*
+ * ===========================================================================
+ *      AssetManager::FileNameCache
+ * ===========================================================================
+ */
+
+AssetManager::FileNameCache::FileNameCache(void)
+    : mNames(NULL), mNamesLen(0), mNamesAlloc(0),
+      mTable(NULL), mTableSize(0), mCount(0)
+{
+}
+
+AssetManager::FileNameCache::~FileNameCache(void)
+{
+    free(mNames);
+    free(mTable);
+}
+
+/*
+ * Same string hash ZipFileRO uses for entry names.
+ */
+/*static*/ uint32_t AssetManager::FileNameCache::computeHash(const char* str, size_t len)
+{
+    uint32_t hash = 0;
+
+    while (len--)
+        hash = hash * 31 + (unsigned char) *str++;
+
+    return hash;
+}
+
+/*
+ * Find the slot holding "name", or the empty slot where it would go.
+ * Returns -1 if the table hasn't been allocated yet.
+ */
+ssize_t AssetManager::FileNameCache::findSlot(const char* name, size_t nameLen,
+    uint32_t hash) const
+{
+    if (mTable == NULL)
+        return -1;
+
+    const size_t mask = mTableSize - 1;
+    size_t idx = hash & mask;
+    while (mTable[idx].offset != kEmptySlot) {
+        const Entry& ent = mTable[idx];
+        if (ent.hash == hash && ent.len == nameLen &&
+            memcmp(mNames + ent.offset, name, nameLen) == 0)
+        {
+            break;
+        }
+        idx = (idx + 1) & mask;
+    }
+    return (ssize_t) idx;
+}
+
+/*
+ * Double the table (or create it), keeping load below 3/4.
+ */
+bool AssetManager::FileNameCache::grow(void)
+{
+    size_t newSize = (mTableSize == 0) ? 64 : mTableSize * 2;
+    Entry* newTable = (Entry*) malloc(newSize * sizeof(Entry));
+    if (newTable == NULL) {
+        LOGE("Unable to grow file name cache to %d slots\n", (int) newSize);
+        return false;
+    }
+    memset(newTable, 0xff, newSize * sizeof(Entry));
+
+    const size_t mask = newSize - 1;
+    for (size_t i = 0; i < mTableSize; i++) {
+        if (mTable[i].offset == kEmptySlot)
+            continue;
+        size_t idx = mTable[i].hash & mask;
+        while (newTable[idx].offset != kEmptySlot)
+            idx = (idx + 1) & mask;
+        newTable[idx] = mTable[i];
+    }
+
+    free(mTable);
+    mTable = newTable;
+    mTableSize = newSize;
+    return true;
+}
+
+void AssetManager::FileNameCache::add(const char* name, size_t nameLen, uint32_t dims)
+{
+    const uint32_t hash = computeHash(name, nameLen);
+    ssize_t idx = findSlot(name, nameLen, hash);
+    if (idx >= 0 && mTable[idx].offset != kEmptySlot) {
+        /*
+         * Already present.  Only let it go when every directory that
+         * produced this name has been invalidated.
+         */
+        mTable[idx].dims &= dims;
+        return;
+    }
+
+    if ((mCount + 1) * 4 > mTableSize * 3) {
+        if (!grow())
+            return;
+        idx = findSlot(name, nameLen, hash);
+    }
+
+    if (mNamesLen + nameLen > mNamesAlloc) {
+        size_t newAlloc = mNamesAlloc == 0 ? 4096 : mNamesAlloc * 2;
+        while (newAlloc < mNamesLen + nameLen)
+            newAlloc *= 2;
+        char* newNames = (char*) realloc(mNames, newAlloc);
+        if (newNames == NULL) {
+            LOGE("Unable to grow file name cache arena to %d bytes\n", (int) newAlloc);
+            return;
+        }
+        mNames = newNames;
+        mNamesAlloc = newAlloc;
+    }
+    memcpy(mNames + mNamesLen, name, nameLen);
+
+    Entry& ent = mTable[idx];
+    ent.hash = hash;
+    ent.offset = (uint32_t) mNamesLen;
+    ent.len = (uint32_t) nameLen;
+    ent.dims = dims;
+
+    mNamesLen += nameLen;
+    mCount++;
+}
+
+bool AssetManager::FileNameCache::contains(const char* name, size_t nameLen) const
+{
+    ssize_t idx = findSlot(name, nameLen, computeHash(name, nameLen));
+    return idx >= 0 && mTable[idx].offset != kEmptySlot;
+}
+
+/*
+ * Rebuild the arena and table from the survivors.  Invalidation is rare
+ * (a locale or vendor switch), so this is simpler than tombstones.
+ */
+void AssetManager::FileNameCache::purge(uint32_t dims)
+{
+    if ((dims & kDimDefault) != 0) {
+        clear();
+        return;
+    }
+
+    char* oldNames = mNames;
+    Entry* oldTable = mTable;
+    const size_t oldSize = mTableSize;
+
+    mNames = NULL;
+    mNamesLen = mNamesAlloc = 0;
+    mTable = NULL;
+    mTableSize = mCount = 0;
+
+    for (size_t i = 0; i < oldSize; i++) {
+        const Entry& ent = oldTable[i];
+        if (ent.offset == kEmptySlot || (ent.dims & dims) != 0)
+            continue;
+        add(oldNames + ent.offset, ent.len, ent.dims);
+    }
+
+    free(oldNames);
+    free(oldTable);
+}
+
+void AssetManager::FileNameCache::clear(void)
+{
+    free(mNames);
+    free(mTable);
+    mNames = NULL;
+    mNamesLen = mNamesAlloc = 0;
+    mTable = NULL;
+    mTableSize = mCount = 0;
+}
+
 /*
  * ===========================================================================
  *      AssetManager::SharedZip
@@ -1726,6 +2305,36 @@ ResTable* AssetManager::SharedZip::setResourceTable(ResTable* res)
     return mResourceTable;
 }
 
+const void* AssetManager::SharedZip::getIdmap(const String8& targetPath, size_t* outSize)
+{
+    AutoMutex _l(gLock);
+    ssize_t idx = mIdmaps.indexOfKey(targetPath);
+    if (idx < 0) {
+        return NULL;
+    }
+    *outSize = mIdmaps.valueAt(idx).size;
+    return mIdmaps.valueAt(idx).data;
+}
+
+const void* AssetManager::SharedZip::setIdmap(const String8& targetPath, void* data,
+                                              size_t size, size_t* outSize)
+{
+    AutoMutex _l(gLock);
+    ssize_t idx = mIdmaps.indexOfKey(targetPath);
+    if (idx >= 0) {
+        // somebody beat us to it
+        free(data);
+        *outSize = mIdmaps.valueAt(idx).size;
+        return mIdmaps.valueAt(idx).data;
+    }
+    idmap_data idmap;
+    idmap.data = data;
+    idmap.size = size;
+    mIdmaps.add(targetPath, idmap);
+    *outSize = size;
+    return data;
+}
+
 bool AssetManager::SharedZip::isUpToDate()
 {
     time_t modWhen = getFileModDate(mPath.string());
@@ -1741,7 +2350,13 @@ AssetManager::SharedZip::~SharedZip()
     if (mResourceTableAsset != NULL) {
         delete mResourceTableAsset;
     }
+    for (size_t i = 0; i < mIdmaps.size(); i++) {
+        free(mIdmaps.valueAt(i).data);
+    }
     if (mZipFile != NULL) {
+        if (gReleasePagesOnClose) {
+            mZipFile->releasePages();
+        }
         delete mZipFile;
         LOGV("Closed '%s'\n", mPath.string());
     }
@@ -1833,6 +2448,28 @@ ResTable* AssetManager::ZipSet::setZipResourceTable(const String8& path,
     return zip->setResourceTable(res);
 }
 
+const void* AssetManager::ZipSet::getZipIdmap(const String8& path,
+                                             const String8& targetPath, size_t* outSize)
+{
+    int idx = getIndex(path);
+    sp<SharedZip> zip = mZipFile[idx];
+    if (zip == NULL) {
+        zip = SharedZip::get(path);
+        mZipFile.editItemAt(idx) = zip;
+    }
+    return zip->getIdmap(targetPath, outSize);
+}
+
+const void* AssetManager::ZipSet::setZipIdmap(const String8& path,
+                                             const String8& targetPath,
+                                             void* data, size_t size, size_t* outSize)
+{
+    int idx = getIndex(path);
+    sp<SharedZip> zip = mZipFile[idx];
+    // doesn't make sense to call before previously accessing.
+    return zip->setIdmap(targetPath, data, size, outSize);
+}
+
 /*
  * Generate the partial pathname for the specified archive.  The caller
  * gets to prepend the asset root directory.
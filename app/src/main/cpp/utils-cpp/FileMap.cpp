@@ -33,6 +33,14 @@
 #include <errno.h>
 #include <assert.h>
 
+/*
+ * Nobody defines HAVE_MADVISE for us; if the headers know about the
+ * advice values, the call is there.
+ */
+#if !defined(HAVE_MADVISE) && defined(MADV_WILLNEED)
+#  define HAVE_MADVISE 1
+#endif
+
 using namespace android;
 
 /*static*/ long FileMap::mPageSize = -1;
@@ -161,8 +169,9 @@ int FileMap::advise(MapAdvice advice)
     }
 
     cc = madvise(mBasePtr, mBaseLength, sysAdvice);
-    if (cc != 0)
+    if (cc != 0) {
         LOGW("madvise(%d) failed: %s\n", sysAdvice, strerror(errno));
+    }
     return cc;
 #else
 	return -1;
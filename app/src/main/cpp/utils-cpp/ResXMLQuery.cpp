@@ -0,0 +1,357 @@
+/*
+ * Copyright (C) 2026 The aapt Authors
+ *
+ * Licensed under the Apache License, Version 2.0 (the "License");
+ * you may not use this file except in compliance with the License.
+ * You may obtain a copy of the License at
+ *
+ *      http://www.apache.org/licenses/LICENSE-2.0
+ *
+ * Unless required by applicable law or agreed to in writing, software
+ * distributed under the License is distributed on an "AS IS" BASIS,
+ * WITHOUT WARRANTIES OR CONDITIONS OF ANY KIND, either express or implied.
+ * See the License for the specific language governing permissions and
+ * limitations under the License.
+ */
+
+//
+// Path queries over binary XML.
+//
+
+#define LOG_TAG "xmlquery"
+#include "../fakeLog.h"
+
+#include "../utils/ResXMLQuery.h"
+
+#include <stdio.h>
+#include <string.h>
+
+using namespace android;
+
+static const char kAndroidNs[] = "http://schemas.android.com/apk/res/android";
+static const char kAndroidPrefix[] = "android:";
+
+static inline bool isNameChar(char c)
+{
+    return c != '\0' && c != '/' && c != '[' && c != ']' && c != '='
+            && c != '@' && c != '\'' && c != '"';
+}
+
+ResXMLQuery::ResXMLQuery(void)
+    : mPool(NULL), mDepth(0)
+{
+    mAndroidNs.text = kAndroidNs;
+    mAndroidNs.count = 0;
+}
+
+ResXMLQuery::~ResXMLQuery(void)
+{
+}
+
+status_t ResXMLQuery::parseName(const char** pos, String8* out)
+{
+    const char* start = *pos;
+    const char* p = start;
+    while (isNameChar(*p)) {
+        p++;
+    }
+    if (p == start) {
+        return BAD_VALUE;
+    }
+    out->setTo(start, p - start);
+    *pos = p;
+    return NO_ERROR;
+}
+
+/*
+ * Parses "@name" or "@android:name"; *pos is at the '@'.
+ */
+status_t ResXMLQuery::parseAttr(const char** pos, attr_ref* out)
+{
+    const char* p = *pos;
+    if (*p++ != '@') {
+        return BAD_VALUE;
+    }
+    out->android = strncmp(p, kAndroidPrefix, sizeof(kAndroidPrefix)-1) == 0;
+    if (out->android) {
+        p += sizeof(kAndroidPrefix)-1;
+    }
+    status_t err = parseName(&p, &out->name.text);
+    if (err != NO_ERROR) {
+        return err;
+    }
+    if (out->name.text.find(":") >= 0) {
+        return BAD_VALUE;
+    }
+    out->name.count = 0;
+    *pos = p;
+    return NO_ERROR;
+}
+
+ssize_t ResXMLQuery::add(const char* selector)
+{
+    query q;
+    q.firstStep = mSteps.size();
+    q.stepCount = 0;
+    q.extract = false;
+    q.matched = 0;
+
+    const size_t firstPredicate = mPredicates.size();
+    const char* p = selector;
+    status_t err = NO_ERROR;
+
+    while (err == NO_ERROR) {
+        if (*p == '@') {
+            // the extractor must be the last thing
+            err = parseAttr(&p, &q.attr);
+            if (err == NO_ERROR && *p != '\0') {
+                err = BAD_VALUE;
+            }
+            q.extract = true;
+            break;
+        }
+
+        step st;
+        st.any = *p == '*';
+        st.name.count = 0;
+        if (st.any) {
+            p++;
+        } else {
+            err = parseName(&p, &st.name.text);
+        }
+        st.firstPredicate = mPredicates.size();
+        st.predicateCount = 0;
+
+        while (err == NO_ERROR && *p == '[') {
+            p++;
+            predicate pr;
+            err = parseAttr(&p, &pr.attr);
+            if (err != NO_ERROR) {
+                break;
+            }
+            pr.hasValue = *p == '=';
+            pr.value.count = 0;
+            if (pr.hasValue) {
+                p++;
+                const char quote = *p++;
+                const char* end = (quote == '\'' || quote == '"') ? strchr(p, quote) : NULL;
+                if (end == NULL) {
+                    err = BAD_VALUE;
+                    break;
+                }
+                pr.value.text.setTo(p, end - p);
+                p = end + 1;
+            }
+            if (*p++ != ']') {
+                err = BAD_VALUE;
+                break;
+            }
+            mPredicates.add(pr);
+            st.predicateCount++;
+        }
+        if (err != NO_ERROR) {
+            break;
+        }
+
+        mSteps.add(st);
+        q.stepCount++;
+        if (*p == '\0') {
+            break;
+        }
+        if (*p++ != '/') {
+            err = BAD_VALUE;
+        }
+    }
+
+    if (err != NO_ERROR || q.stepCount == 0) {
+        LOGW("Bad XML query selector '%s' at offset %d\n", selector, (int)(p - selector));
+        mSteps.removeItemsAt(q.firstStep, mSteps.size() - q.firstStep);
+        mPredicates.removeItemsAt(firstPredicate, mPredicates.size() - firstPredicate);
+        return BAD_VALUE;
+    }
+
+    mMatches.add(Vector<match>());
+    return mQueries.add(q);
+}
+
+void ResXMLQuery::resolve(const ResStringPool& pool, name_ref* ref) const
+{
+    ref->count = pool.indicesOfString8(ref->text.string(), ref->text.length(),
+            ref->indices, MAX_NAME_INDICES);
+}
+
+bool ResXMLQuery::contains(const name_ref& ref, int32_t index) const
+{
+    if (index < 0) {
+        return false;
+    }
+    for (size_t i = 0; i < ref.count; i++) {
+        if ((int32_t)ref.indices[i] == index) {
+            return true;
+        }
+    }
+    // The pool may hold more copies than resolve() kept; compare those
+    // by value.
+    return ref.count >= MAX_NAME_INDICES
+            && mPool->string8Equals(index, ref.text.string(), ref.text.length());
+}
+
+status_t ResXMLQuery::begin(const ResXMLParser& parser)
+{
+    const ResStringPool& pool = parser.getStrings();
+    if (pool.getError() != NO_ERROR) {
+        return pool.getError();
+    }
+
+    mPool = &pool;
+    resolve(pool, &mAndroidNs);
+    for (size_t i = 0; i < mSteps.size(); i++) {
+        step& st = mSteps.editItemAt(i);
+        if (!st.any) {
+            resolve(pool, &st.name);
+        }
+    }
+    for (size_t i = 0; i < mPredicates.size(); i++) {
+        predicate& pr = mPredicates.editItemAt(i);
+        resolve(pool, &pr.attr.name);
+        if (pr.hasValue) {
+            resolve(pool, &pr.value);
+        }
+    }
+    for (size_t i = 0; i < mQueries.size(); i++) {
+        query& q = mQueries.editItemAt(i);
+        q.matched = 0;
+        if (q.extract) {
+            resolve(pool, &q.attr.name);
+        }
+        mMatches.editItemAt(i).clear();
+    }
+    mDepth = 0;
+    return NO_ERROR;
+}
+
+ssize_t ResXMLQuery::findAttribute(const ResXMLParser& parser, const attr_ref& attr) const
+{
+    if (attr.name.count == 0) {
+        return NAME_NOT_FOUND;
+    }
+    const size_t N = parser.getAttributeCount();
+    for (size_t i = 0; i < N; i++) {
+        if (!contains(attr.name, parser.getAttributeNameID(i))) {
+            continue;
+        }
+        const int32_t ns = parser.getAttributeNamespaceID(i);
+        if (attr.android ? contains(mAndroidNs, ns) : ns < 0) {
+            return i;
+        }
+    }
+    return NAME_NOT_FOUND;
+}
+
+bool ResXMLQuery::matchStep(const ResXMLParser& parser, const step& st) const
+{
+    if (!st.any && !contains(st.name, parser.getElementNameID())) {
+        return false;
+    }
+    for (size_t i = 0; i < st.predicateCount; i++) {
+        const predicate& pr = mPredicates[st.firstPredicate + i];
+        const ssize_t idx = findAttribute(parser, pr.attr);
+        if (idx < 0) {
+            return false;
+        }
+        if (pr.hasValue && !contains(pr.value, parser.getAttributeValueStringID(idx))) {
+            return false;
+        }
+    }
+    return true;
+}
+
+void ResXMLQuery::addMatch(const ResXMLParser& parser, size_t q)
+{
+    const query& qu = mQueries[q];
+    match m;
+    m.hasValue = false;
+    if (qu.extract) {
+        const ssize_t idx = findAttribute(parser, qu.attr);
+        if (idx < 0) {
+            return;
+        }
+        if (parser.getAttributeValue(idx, &m.value) < 0) {
+            return;
+        }
+        m.hasValue = true;
+        const int32_t strId = parser.getAttributeValueStringID(idx);
+        if (strId >= 0) {
+            m.text = parser.getStrings().string8ObjectAt(strId);
+        } else {
+            char buf[64];
+            m.value.format(buf, sizeof(buf));
+            m.text = buf;
+        }
+    }
+    mMatches.editItemAt(q).add(m);
+}
+
+/*
+ * A query's 'matched' count only ever covers the elements on the path
+ * from the root to the current element, so a start tag at depth d can
+ * only extend queries that have matched exactly d steps, and its end
+ * tag undoes that.
+ */
+void ResXMLQuery::feed(const ResXMLParser& parser, ResXMLParser::event_code_t code)
+{
+    if (code == ResXMLParser::START_TAG) {
+        const size_t depth = mDepth++;
+        for (size_t i = 0; i < mQueries.size(); i++) {
+            query& q = mQueries.editItemAt(i);
+            if (q.matched != depth || depth >= q.stepCount) {
+                continue;
+            }
+            if (matchStep(parser, mSteps[q.firstStep + depth])) {
+                q.matched = depth+1;
+                if (q.matched == q.stepCount) {
+                    addMatch(parser, i);
+                }
+            }
+        }
+    } else if (code == ResXMLParser::END_TAG && mDepth > 0) {
+        const size_t depth = --mDepth;
+        for (size_t i = 0; i < mQueries.size(); i++) {
+            query& q = mQueries.editItemAt(i);
+            if (q.matched == depth+1) {
+                q.matched = depth;
+            }
+        }
+    }
+}
+
+status_t ResXMLQuery::run(ResXMLParser& parser)
+{
+    status_t err = begin(parser);
+    if (err != NO_ERROR) {
+        return err;
+    }
+    parser.restart();
+    ResXMLParser::event_code_t code;
+    while ((code = parser.next()) != ResXMLParser::END_DOCUMENT
+            && code != ResXMLParser::BAD_DOCUMENT) {
+        feed(parser, code);
+    }
+    return code == ResXMLParser::END_DOCUMENT ? NO_ERROR : BAD_TYPE;
+}
+
+size_t ResXMLQuery::getMatchCount(size_t query) const
+{
+    return query < mMatches.size() ? mMatches[query].size() : 0;
+}
+
+const String8& ResXMLQuery::getMatch(size_t query, size_t idx) const
+{
+    return mMatches[query][idx].text;
+}
+
+const Res_value* ResXMLQuery::getMatchValue(size_t query, size_t idx) const
+{
+    const match& m = mMatches[query][idx];
+    return m.hasValue ? &m.value : NULL;
+}
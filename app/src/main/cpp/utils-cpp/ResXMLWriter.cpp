@@ -0,0 +1,329 @@
+/*
+ * Copyright (C) 2026 The aapt Authors
+ *
+ * Licensed under the Apache License, Version 2.0 (the "License");
+ * you may not use this file except in compliance with the License.
+ * You may obtain a copy of the License at
+ *
+ *      http://www.apache.org/licenses/LICENSE-2.0
+ *
+ * Unless required by applicable law or agreed to in writing, software
+ * distributed under the License is distributed on an "AS IS" BASIS,
+ * WITHOUT WARRANTIES OR CONDITIONS OF ANY KIND, either express or implied.
+ * See the License for the specific language governing permissions and
+ * limitations under the License.
+ */
+
+//
+// Binary XML to text XML.
+//
+
+#define LOG_TAG "xmlwriter"
+#include "../fakeLog.h"
+
+#include "../utils/ResXMLWriter.h"
+#include "../utils/Unicode.h"
+
+#include <stdlib.h>
+#include <string.h>
+#include <errno.h>
+#include <unistd.h>
+
+using namespace android;
+
+/*
+ * UTF-16 strings are converted this many units at a time; the worst
+ * case is three UTF-8 bytes per unit.
+ */
+static const size_t kUtf16Chunk = 256;
+
+ResXMLWriter::ResXMLWriter(char* buf, size_t size)
+    : mBuf(size > 0 ? buf : NULL), mSize(size > 0 ? size-1 : 0), mPos(0), mLength(0),
+      mFd(-1), mError(NO_ERROR)
+{
+    // mSize leaves room for the terminating NUL
+}
+
+ResXMLWriter::ResXMLWriter(int fd)
+    : mBuf(NULL), mSize(0), mPos(0), mLength(0), mFd(fd), mError(NO_ERROR)
+{
+    mBuf = (char*) malloc(FD_BUFFER_SIZE);
+    if (mBuf == NULL) {
+        mError = NO_MEMORY;
+    } else {
+        mSize = FD_BUFFER_SIZE;
+    }
+}
+
+ResXMLWriter::~ResXMLWriter(void)
+{
+    if (mFd >= 0) {
+        flush();
+        free(mBuf);
+    }
+}
+
+void ResXMLWriter::flush(void)
+{
+    const char* p = mBuf;
+    size_t left = mPos;
+    mPos = 0;
+    while (left > 0 && mError == NO_ERROR) {
+        const ssize_t n = ::write(mFd, p, left);
+        if (n < 0) {
+            if (errno == EINTR) {
+                continue;
+            }
+            LOGW("Unable to write XML text: %s\n", strerror(errno));
+            mError = -errno;
+            break;
+        }
+        p += n;
+        left -= n;
+    }
+}
+
+void ResXMLWriter::append(const char* str, size_t len)
+{
+    mLength += len;
+    while (len > 0) {
+        if (mPos == mSize) {
+            if (mFd < 0 || mError != NO_ERROR) {
+                return;
+            }
+            flush();
+        }
+        const size_t n = len < mSize-mPos ? len : mSize-mPos;
+        memcpy(mBuf+mPos, str, n);
+        mPos += n;
+        str += n;
+        len -= n;
+    }
+}
+
+void ResXMLWriter::append(const char* str)
+{
+    append(str, strlen(str));
+}
+
+/*
+ * Copies runs of ordinary bytes in one go; everything that needs an
+ * entity is at or below '>', so most bytes cost one compare.  Inside
+ * attribute values quotes and line breaks are escaped as well.
+ */
+void ResXMLWriter::appendEscaped(const char* str, size_t len, bool attr)
+{
+    const char* run = str;
+    const char* const end = str + len;
+    for (const char* p = str; p < end; p++) {
+        const unsigned char c = (unsigned char)*p;
+        if (c > '>') {
+            continue;
+        }
+        const char* entity;
+        switch (c) {
+            case '&':   entity = "&amp;"; break;
+            case '<':   entity = "&lt;"; break;
+            case '>':   entity = "&gt;"; break;
+            case '"':   entity = attr ? "&quot;" : NULL; break;
+            case '\n':  entity = attr ? "&#10;" : NULL; break;
+            case '\r':  entity = attr ? "&#13;" : NULL; break;
+            case '\t':  entity = attr ? "&#9;" : NULL; break;
+            default:    entity = NULL; break;
+        }
+        if (entity != NULL) {
+            append(run, p - run);
+            append(entity);
+            run = p + 1;
+        }
+    }
+    append(run, end - run);
+}
+
+void ResXMLWriter::appendString(const ResStringPool& pool, int32_t idx, bool attr)
+{
+    if (idx < 0) {
+        return;
+    }
+    size_t len;
+    const char* str8 = pool.string8At(idx, &len);
+    if (str8 != NULL) {
+        appendEscaped(str8, len, attr);
+        return;
+    }
+    const uint16_t* str16 = pool.stringAt(idx, &len);
+    if (str16 == NULL) {
+        return;
+    }
+    char buf[kUtf16Chunk*3 + 1];
+    while (len > 0) {
+        size_t n = len < kUtf16Chunk ? len : kUtf16Chunk;
+        // don't split a surrogate pair across chunks
+        if (n < len && (str16[n-1] & 0xfc00) == 0xd800) {
+            n--;
+        }
+        utf16_to_utf8(str16, n, buf);
+        appendEscaped(buf, strlen(buf), attr);
+        str16 += n;
+        len -= n;
+    }
+}
+
+/*
+ * Namespaced names use the innermost prefix bound to their URI.  A URI
+ * with no binding in scope is dropped rather than made up.
+ */
+void ResXMLWriter::appendName(const ResXMLParser& parser, int32_t ns, int32_t name)
+{
+    if (ns >= 0) {
+        for (size_t i = mNamespaces.size(); i > 0; i--) {
+            const ns_binding& b = mNamespaces[i-1];
+            if (b.uri == ns) {
+                if (b.prefix >= 0) {
+                    appendString(parser.getStrings(), b.prefix, false);
+                    append(":", 1);
+                }
+                break;
+            }
+        }
+    }
+    appendString(parser.getStrings(), name, false);
+}
+
+void ResXMLWriter::appendIndent(size_t depth)
+{
+    static const char kSpaces[] = "                                ";
+    size_t n = depth * 4;
+    while (n > 0) {
+        const size_t chunk = n < sizeof(kSpaces)-1 ? n : sizeof(kSpaces)-1;
+        append(kSpaces, chunk);
+        n -= chunk;
+    }
+}
+
+status_t ResXMLWriter::write(ResXMLParser& parser)
+{
+    if (mError != NO_ERROR) {
+        return mError;
+    }
+    const ResStringPool& pool = parser.getStrings();
+    mNamespaces.clear();
+
+    append("<?xml version=\"1.0\" encoding=\"utf-8\"?>\n");
+
+    size_t depth = 0;
+    size_t pendingNs = 0;       // bindings not yet written as xmlns attributes
+    bool open = false;          // a start tag is still waiting for its '>'
+    bool text = false;          // the last thing written was character data
+
+    parser.restart();
+    ResXMLParser::event_code_t code;
+    while ((code = parser.next()) != ResXMLParser::END_DOCUMENT
+            && code != ResXMLParser::BAD_DOCUMENT) {
+        switch (code) {
+            case ResXMLParser::START_NAMESPACE: {
+                ns_binding b;
+                b.prefix = parser.getNamespacePrefixID();
+                b.uri = parser.getNamespaceUriID();
+                mNamespaces.push(b);
+                pendingNs++;
+                break;
+            }
+            case ResXMLParser::END_NAMESPACE:
+                if (mNamespaces.size() > 0) {
+                    mNamespaces.pop();
+                }
+                if (pendingNs > mNamespaces.size()) {
+                    pendingNs = mNamespaces.size();
+                }
+                break;
+            case ResXMLParser::START_TAG: {
+                if (open) {
+                    append(">\n", 2);
+                } else if (text) {
+                    append("\n", 1);
+                }
+                appendIndent(depth);
+                append("<", 1);
+                appendName(parser, parser.getElementNamespaceID(), parser.getElementNameID());
+
+                for (size_t i = mNamespaces.size()-pendingNs; i < mNamespaces.size(); i++) {
+                    const ns_binding& b = mNamespaces[i];
+                    append(" xmlns", 6);
+                    if (b.prefix >= 0) {
+                        append(":", 1);
+                        appendString(pool, b.prefix, false);
+                    }
+                    append("=\"", 2);
+                    appendString(pool, b.uri, true);
+                    append("\"", 1);
+                }
+                pendingNs = 0;
+
+                const size_t N = parser.getAttributeCount();
+                for (size_t i = 0; i < N; i++) {
+                    append(" ", 1);
+                    appendName(parser, parser.getAttributeNamespaceID(i),
+                               parser.getAttributeNameID(i));
+                    append("=\"", 2);
+                    const int32_t strId = parser.getAttributeValueStringID(i);
+                    Res_value value;
+                    if (strId >= 0) {
+                        appendString(pool, strId, true);
+                    } else if (parser.getAttributeValue(i, &value) >= 0) {
+                        char buf[64];
+                        const int n = value.format(buf, sizeof(buf));
+                        if (n > 0) {
+                            append(buf, (size_t)n < sizeof(buf) ? n : sizeof(buf)-1);
+                        }
+                    }
+                    append("\"", 1);
+                }
+
+                open = true;
+                text = false;
+                depth++;
+                break;
+            }
+            case ResXMLParser::END_TAG:
+                if (depth > 0) {
+                    depth--;
+                }
+                if (open) {
+                    append(" />\n", 4);
+                } else {
+                    if (!text) {
+                        appendIndent(depth);
+                    }
+                    append("</", 2);
+                    appendName(parser, parser.getElementNamespaceID(),
+                               parser.getElementNameID());
+                    append(">\n", 2);
+                }
+                open = false;
+                text = false;
+                break;
+            case ResXMLParser::TEXT:
+                if (open) {
+                    append(">", 1);
+                    open = false;
+                }
+                appendString(pool, parser.getTextID(), false);
+                text = true;
+                break;
+            default:
+                break;
+        }
+    }
+
+    if (mFd >= 0) {
+        flush();
+    } else if (mBuf != NULL) {
+        mBuf[mPos] = '\0';
+    }
+
+    if (mError == NO_ERROR && code == ResXMLParser::BAD_DOCUMENT) {
+        return BAD_TYPE;
+    }
+    return mError;
+}
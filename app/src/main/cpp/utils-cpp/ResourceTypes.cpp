@@ -30,6 +30,7 @@
 #include <memory.h>
 #include <ctype.h>
 #include <stdint.h>
+#include <unistd.h>
 
 #ifndef INT32_MAX
 #define INT32_MAX ((int32_t)(2147483647))
@@ -132,6 +133,61 @@ inline void Res_value::copyFrom_dtoh(const Res_value& src)
     data = dtohl(src.data);
 }
 
+static float complexToFloat(uint32_t complex)
+{
+    static const float MANTISSA_MULT =
+        1.0f / (1<<Res_value::COMPLEX_MANTISSA_SHIFT);
+    static const float RADIX_MULTS[] = {
+        1.0f*MANTISSA_MULT, 1.0f/(1<<7)*MANTISSA_MULT,
+        1.0f/(1<<15)*MANTISSA_MULT, 1.0f/(1<<23)*MANTISSA_MULT
+    };
+    // the mantissa is the signed top 24 bits
+    const int32_t mantissa = (int32_t)(complex
+            & (Res_value::COMPLEX_MANTISSA_MASK<<Res_value::COMPLEX_MANTISSA_SHIFT));
+    return mantissa * RADIX_MULTS[(complex>>Res_value::COMPLEX_RADIX_SHIFT)
+                                  & Res_value::COMPLEX_RADIX_MASK];
+}
+
+int Res_value::format(char* buf, size_t bufSize) const
+{
+    const uint32_t unit = (data>>COMPLEX_UNIT_SHIFT)&COMPLEX_UNIT_MASK;
+    switch (dataType) {
+        case TYPE_NULL:
+        case TYPE_STRING:
+            if (bufSize > 0) buf[0] = '\0';
+            return 0;
+        case TYPE_REFERENCE:
+            return snprintf(buf, bufSize, "@0x%08x", data);
+        case TYPE_ATTRIBUTE:
+            return snprintf(buf, bufSize, "?0x%08x", data);
+        case TYPE_FLOAT: {
+            union { uint32_t u; float f; } bits;
+            bits.u = data;
+            return snprintf(buf, bufSize, "%g", bits.f);
+        }
+        case TYPE_DIMENSION: {
+            static const char* const kUnits[] = { "px", "dip", "sp", "pt", "in", "mm" };
+            return snprintf(buf, bufSize, "%g%s", complexToFloat(data),
+                            unit < sizeof(kUnits)/sizeof(kUnits[0]) ? kUnits[unit] : "");
+        }
+        case TYPE_FRACTION:
+            return snprintf(buf, bufSize, "%g%s", complexToFloat(data)*100,
+                            unit == COMPLEX_UNIT_FRACTION_PARENT ? "%p" : "%");
+        case TYPE_INT_HEX:
+            return snprintf(buf, bufSize, "0x%x", data);
+        case TYPE_INT_BOOLEAN:
+            return snprintf(buf, bufSize, "%s", data ? "true" : "false");
+        default:
+            if (dataType >= TYPE_FIRST_COLOR_INT && dataType <= TYPE_LAST_COLOR_INT) {
+                return snprintf(buf, bufSize, "#%08x", data);
+            }
+            if (dataType >= TYPE_FIRST_INT && dataType <= TYPE_LAST_INT) {
+                return snprintf(buf, bufSize, "%d", (int32_t)data);
+            }
+            return snprintf(buf, bufSize, "0x%08x", data);
+    }
+}
+
 void Res_png_9patch::deviceToFile()
 {
     for (int i = 0; i < numXDivs; i++) {
@@ -306,13 +362,33 @@ Res_png_9patch* Res_png_9patch::deserialize(const void* inData)
 // --------------------------------------------------------------------
 // --------------------------------------------------------------------
 
+/*
+ * Decoded UTF-16 copies of UTF-8 strings are carved out of large chunks
+ * instead of being malloc'd one at a time; the whole lot goes away in
+ * uninit().
+ */
+struct ResStringPool::decode_chunk
+{
+    decode_chunk*   next;
+    size_t          used;       // in uint16_t units
+    size_t          avail;      // in uint16_t units
+    uint16_t        data[1];
+};
+
+static const size_t kDecodeChunkChars = 16*1024;
+
+static const size_t kCachePageShift = 12;
+static const size_t kCachePageSize = 1 << kCachePageShift;
+
 ResStringPool::ResStringPool()
-    : mError(NO_INIT), mOwnedData(NULL), mHeader(NULL), mCache(NULL)
+    : mError(NO_INIT), mOwnedData(NULL), mHeader(NULL), mDecodeChunks(NULL),
+      mCache(NULL), mCachePages(0), mIndex(NULL)
 {
 }
 
 ResStringPool::ResStringPool(const void* data, size_t size, bool copyData)
-    : mError(NO_INIT), mOwnedData(NULL), mHeader(NULL), mCache(NULL)
+    : mError(NO_INIT), mOwnedData(NULL), mHeader(NULL), mDecodeChunks(NULL),
+      mCache(NULL), mCachePages(0), mIndex(NULL)
 {
     setTo(data, size, copyData);
 }
@@ -378,8 +454,15 @@ status_t ResStringPool::setTo(const void* data, size_t size, bool copyData)
         size_t charSize;
         if (mHeader->flags&ResStringPool_header::UTF8_FLAG) {
             charSize = sizeof(uint8_t);
-            mCache = (uint16_t**)malloc(sizeof(uint16_t**)*mHeader->stringCount);
-            memset(mCache, 0, sizeof(uint16_t**)*mHeader->stringCount);
+            // Only the page table is allocated here; badging-style
+            // lookups touch a handful of strings and so a page or two.
+            mCachePages = (mHeader->stringCount+kCachePageSize-1) >> kCachePageShift;
+            mCache = (uint16_t* volatile* volatile*)calloc(mCachePages,
+                    sizeof(uint16_t* volatile*));
+            if (mCache == NULL) {
+                mCachePages = 0;
+                return (mError=NO_MEMORY);
+            }
         } else {
             charSize = sizeof(uint16_t);
         }
@@ -418,17 +501,9 @@ status_t ResStringPool::setTo(const void* data, size_t size, bool copyData)
         }
 
         if (notDeviceEndian) {
-            size_t i;
-            uint32_t* e = const_cast<uint32_t*>(mEntries);
-            for (i=0; i<mHeader->stringCount; i++) {
-                e[i] = dtohl(mEntries[i]);
-            }
+            android_swap_longs(const_cast<uint32_t*>(mEntries), mHeader->stringCount);
             if (!(mHeader->flags&ResStringPool_header::UTF8_FLAG)) {
-                const uint16_t* strings = (const uint16_t*)mStrings;
-                uint16_t* s = const_cast<uint16_t*>(strings);
-                for (i=0; i<mStringPoolSize; i++) {
-                    s[i] = dtohs(strings[i]);
-                }
+                android_swap_shorts((uint16_t*)mStrings, mStringPoolSize);
             }
         }
 
@@ -469,15 +544,8 @@ status_t ResStringPool::setTo(const void* data, size_t size, bool copyData)
             (mHeader->header.size-mHeader->stylesStart)/sizeof(uint32_t);
 
         if (notDeviceEndian) {
-            size_t i;
-            uint32_t* e = const_cast<uint32_t*>(mEntryStyles);
-            for (i=0; i<mHeader->styleCount; i++) {
-                e[i] = dtohl(mEntryStyles[i]);
-            }
-            uint32_t* s = const_cast<uint32_t*>(mStyles);
-            for (i=0; i<mStylePoolSize; i++) {
-                s[i] = dtohl(mStyles[i]);
-            }
+            android_swap_longs(const_cast<uint32_t*>(mEntryStyles), mHeader->styleCount);
+            android_swap_longs(const_cast<uint32_t*>(mStyles), mStylePoolSize);
         }
 
         const ResStringPool_span endSpan = {
@@ -510,16 +578,91 @@ void ResStringPool::uninit()
         free(mOwnedData);
         mOwnedData = NULL;
     }
-    if (mHeader != NULL && mCache != NULL) {
-        for (size_t x = 0; x < mHeader->stringCount; x++) {
-            if (mCache[x] != NULL) {
-                free(mCache[x]);
-                mCache[x] = NULL;
-            }
+    if (mCache != NULL) {
+        for (size_t i=0; i<mCachePages; i++) {
+            free((void*)mCache[i]);
         }
-        free(mCache);
+        free((void*)mCache);
         mCache = NULL;
+        mCachePages = 0;
+    }
+    if (mIndex != NULL) {
+        free(mIndex);
+        mIndex = NULL;
+    }
+    // Every decoded string lives in one of the chunks, so there is
+    // nothing to free per string.
+    while (mDecodeChunks != NULL) {
+        decode_chunk* next = mDecodeChunks->next;
+        free(mDecodeChunks);
+        mDecodeChunks = next;
+    }
+}
+
+uint16_t* ResStringPool::cachedString(size_t idx) const
+{
+    uint16_t* volatile* page = mCache[idx >> kCachePageShift];
+    return page != NULL ? page[idx & (kCachePageSize-1)] : NULL;
+}
+
+/*
+ * Publishes 'str' as the decoded form of string 'idx', allocating its
+ * cache page if this is the first string decoded there.  Returns the
+ * string that ended up in the cache, which is someone else's if another
+ * thread got there first, or NULL if the page could not be allocated.
+ */
+uint16_t* ResStringPool::publishString(size_t idx, uint16_t* str) const
+{
+    uint16_t* volatile* volatile* pagep = &mCache[idx >> kCachePageShift];
+    uint16_t* volatile* page = *pagep;
+    if (page == NULL) {
+        page = (uint16_t* volatile*)calloc(kCachePageSize, sizeof(uint16_t*));
+        if (page == NULL) {
+            return NULL;
+        }
+        if (!__sync_bool_compare_and_swap(pagep, (uint16_t* volatile*)NULL, page)) {
+            free((void*)page);
+            page = *pagep;
+        }
+    }
+    uint16_t* volatile* slot = &page[idx & (kCachePageSize-1)];
+    if (!__sync_bool_compare_and_swap(slot, (uint16_t*)NULL, str)) {
+        return *slot;
     }
+    return str;
+}
+
+uint16_t* ResStringPool::allocDecodeBuffer(size_t count) const
+{
+    AutoMutex lock(mDecodeLock);
+
+    if (count > (((size_t)-1)-sizeof(decode_chunk))/sizeof(uint16_t)) {
+        return NULL;
+    }
+
+    decode_chunk* chunk = mDecodeChunks;
+    if (chunk == NULL || chunk->avail-chunk->used < count) {
+        size_t avail = count > kDecodeChunkChars ? count : kDecodeChunkChars;
+        chunk = (decode_chunk*)malloc(sizeof(decode_chunk)+avail*sizeof(uint16_t));
+        if (chunk == NULL) {
+            return NULL;
+        }
+        chunk->used = 0;
+        chunk->avail = avail;
+        if (mDecodeChunks != NULL && avail > kDecodeChunkChars) {
+            // Keep filling the current chunk; an oversized string gets
+            // its own chunk linked in behind it.
+            chunk->next = mDecodeChunks->next;
+            mDecodeChunks->next = chunk;
+        } else {
+            chunk->next = mDecodeChunks;
+            mDecodeChunks = chunk;
+        }
+    }
+
+    uint16_t* buf = chunk->data + chunk->used;
+    chunk->used += count;
+    return buf;
 }
 
 /**
@@ -566,6 +709,95 @@ decodeLength(const uint8_t** str)
     return len;
 }
 
+/*
+ * setTo() only checks the pool's outline, and each string is checked
+ * when it is first read.  That has to stay so: obfuscated APKs routinely
+ * carry unreachable garbage entries that lazy access never trips over.
+ * Callers that would rather reject a corrupt pool outright, before
+ * anything is read from it, call this once after setTo().
+ */
+status_t ResStringPool::validate() const
+{
+    if (mError != NO_ERROR) {
+        return mError;
+    }
+
+    const size_t N = mHeader->stringCount;
+    if (N > 0) {
+        const bool isUTF8 = (mHeader->flags&ResStringPool_header::UTF8_FLAG) != 0;
+        const size_t charSize = isUTF8 ? sizeof(uint8_t) : sizeof(uint16_t);
+        const uint32_t limit = (mStringPoolSize-1)*charSize;
+
+        // Offsets first, as a branch-free max the compiler can vectorize.
+        uint32_t maxOff = 0;
+        for (size_t i=0; i<N; i++) {
+            maxOff = mEntries[i] > maxOff ? mEntries[i] : maxOff;
+        }
+        if (maxOff >= limit) {
+            for (size_t i=0; i<N; i++) {
+                if (mEntries[i] >= limit) {
+                    LOGW("Bad string block: string #%d entry is at %d, past end at %d\n",
+                            (int)i, (int)mEntries[i], (int)limit);
+                    break;
+                }
+            }
+            return BAD_TYPE;
+        }
+
+        for (size_t i=0; i<N; i++) {
+            size_t len, encLen;
+            bool ok;
+            if (isUTF8) {
+                const uint8_t* const end = (const uint8_t*)mStrings + mStringPoolSize;
+                const uint8_t* str = (const uint8_t*)mStrings + mEntries[i];
+                // off < size-1, so both bytes of the first prefix are in
+                // range; the second prefix needs checking.
+                len = decodeLength(&str);
+                ok = str < end && ((*str&0x80) == 0 || str+1 < end);
+                if (ok) {
+                    encLen = decodeLength(&str);
+                    ok = encLen < (size_t)(end-str) && str[encLen] == 0;
+                }
+            } else {
+                const uint16_t* const end = (const uint16_t*)mStrings + mStringPoolSize;
+                const uint16_t* str = (const uint16_t*)mStrings + mEntries[i]/sizeof(uint16_t);
+                ok = (*str&0x8000) == 0 || str+1 < end;
+                if (ok) {
+                    len = decodeLength(&str);
+                    ok = len < (size_t)(end-str) && str[len] == 0;
+                }
+            }
+            if (!ok) {
+                LOGW("Bad string block: string #%d is truncated or not 0-terminated\n", (int)i);
+                return BAD_TYPE;
+            }
+        }
+    }
+
+    for (size_t i=0; i<mHeader->styleCount; i++) {
+        size_t off = mEntryStyles[i]/sizeof(uint32_t);
+        for (;;) {
+            if (off >= mStylePoolSize) {
+                LOGW("Bad string block: style #%d runs past end at %d\n",
+                        (int)i, (int)(mStylePoolSize*sizeof(uint32_t)));
+                return BAD_TYPE;
+            }
+            const uint32_t name = mStyles[off];
+            if (name == ResStringPool_span::END) {
+                break;
+            }
+            if (name >= N || off+3 > mStylePoolSize) {
+                LOGW("Bad string block: style #%d has a bad span at %d\n",
+                        (int)i, (int)(off*sizeof(uint32_t)));
+                return BAD_TYPE;
+            }
+            off += sizeof(ResStringPool_span)/sizeof(uint32_t);
+        }
+    }
+
+    return NO_ERROR;
+}
+
 const uint16_t* ResStringPool::stringAt(size_t idx, size_t* u16len) const
 {
     if (mError == NO_ERROR && idx < mHeader->stringCount) {
@@ -592,10 +824,12 @@ const uint16_t* ResStringPool::stringAt(size_t idx, size_t* u16len) const
 
                 // encLen must be less than 0x7FFF due to encoding.
                 if ((uint32_t)(u8str+u8len-strings) < mStringPoolSize) {
-                    AutoMutex lock(mDecodeLock);
-
-                    if (mCache[idx] != NULL) {
-                        return mCache[idx];
+                    // Readers never take a lock.  Two threads missing on the
+                    // same string both decode it; whichever publishes first
+                    // wins and the loser's copy just stays in the arena.
+                    uint16_t* cached = cachedString(idx);
+                    if (cached != NULL) {
+                        return cached;
                     }
 
                     ssize_t actualLen = utf8_to_utf16_length(u8str, u8len);
@@ -606,7 +840,7 @@ const uint16_t* ResStringPool::stringAt(size_t idx, size_t* u16len) const
                         return NULL;
                     }
 
-                    uint16_t *u16str = (uint16_t *)calloc(*u16len+1, sizeof(uint16_t));
+                    uint16_t *u16str = allocDecodeBuffer(*u16len+1);
                     if (!u16str) {
                         LOGW("No memory when trying to allocate decode cache for string #%d\n",
                                 (int)idx);
@@ -614,8 +848,12 @@ const uint16_t* ResStringPool::stringAt(size_t idx, size_t* u16len) const
                     }
 
                     utf8_to_utf16(u8str, u8len, u16str);
-                    mCache[idx] = u16str;
-                    return u16str;
+                    uint16_t* published = publishString(idx, u16str);
+                    if (published == NULL) {
+                        LOGW("No memory when trying to allocate decode cache for string #%d\n",
+                                (int)idx);
+                    }
+                    return published;
                 } else {
                     LOGW("Bad string block: string #%lld extends to %lld, past end at %lld\n",
                             (long long)idx, (long long)(u8str+u8len-strings),
@@ -631,6 +869,141 @@ const uint16_t* ResStringPool::stringAt(size_t idx, size_t* u16len) const
     return NULL;
 }
 
+/*
+ * Locates UTF-8 string 'idx' without any logging; used by the bulk
+ * decoder, which leaves bad entries for stringAt() to report.  UTF-8
+ * never needs more UTF-16 units than it has bytes, so a string whose
+ * prefixes claim otherwise is rejected here; that keeps an untrusted
+ * u16len from sizing the slab.
+ */
+const uint8_t* ResStringPool::utf8StringAt(size_t idx, size_t* u16len, size_t* u8len) const
+{
+    const uint32_t off = mEntries[idx];
+    if (off >= (mStringPoolSize-1)) {
+        return NULL;
+    }
+    const uint8_t* strings = (const uint8_t*)mStrings;
+    const uint8_t* u8str = strings+off;
+    *u16len = decodeLength(&u8str);
+    *u8len = decodeLength(&u8str);
+    if ((uint32_t)(u8str+*u8len-strings) >= mStringPoolSize || *u16len > *u8len) {
+        return NULL;
+    }
+    return u8str;
+}
+
+/*
+ * Decodes strings [start, end) into consecutive NUL-terminated runs at
+ * 'dest'.  Each string's slot in the slab is reserved even if it turns
+ * out to be malformed, so every range's layout is known in advance.
+ */
+void ResStringPool::decodeRange(size_t start, size_t end, uint16_t* dest) const
+{
+    for (size_t i=start; i<end; i++) {
+        size_t u16len, u8len;
+        const uint8_t* u8str = utf8StringAt(i, &u16len, &u8len);
+        if (u8str == NULL) {
+            continue;
+        }
+        uint16_t* u16str = dest;
+        dest += u16len+1;
+        if (cachedString(i) != NULL) {
+            continue;
+        }
+        ssize_t actualLen = utf8_to_utf16_length(u8str, u8len);
+        if (actualLen < 0 || (size_t)actualLen != u16len) {
+            continue;
+        }
+        utf8_to_utf16(u8str, u8len, u16str);
+        publishString(i, u16str);
+    }
+}
+
+struct decode_range_args
+{
+    const ResStringPool*    pool;
+    size_t                  start;
+    size_t                  end;
+    uint16_t*               dest;
+};
+
+void* ResStringPool::decodeRangeThread(void* arg)
+{
+    const decode_range_args* a = (const decode_range_args*)arg;
+    a->pool->decodeRange(a->start, a->end, a->dest);
+    return NULL;
+}
+
+static const size_t kParallelDecodeMinStrings = 100000;
+static const size_t kMaxDecodeThreads = 4;
+
+status_t ResStringPool::decodeAllStrings() const
+{
+    if (mError != NO_ERROR) {
+        return mError;
+    }
+    if ((mHeader->flags&ResStringPool_header::UTF8_FLAG) == 0 || mHeader->stringCount == 0) {
+        return NO_ERROR;
+    }
+
+    const size_t N = mHeader->stringCount;
+    size_t numThreads = 1;
+    if (N >= kParallelDecodeMinStrings) {
+        long cpus = sysconf(_SC_NPROCESSORS_ONLN);
+        numThreads = cpus > 1 ? (size_t)cpus : 1;
+        if (numThreads > kMaxDecodeThreads) {
+            numThreads = kMaxDecodeThreads;
+        }
+    }
+
+    // Size the slab, and each range's starting point in it, from the
+    // length prefixes alone.
+    decode_range_args ranges[kMaxDecodeThreads];
+    size_t offsets[kMaxDecodeThreads];
+    size_t total = 0;
+    for (size_t t=0; t<numThreads; t++) {
+        ranges[t].pool = this;
+        ranges[t].start = (N*t)/numThreads;
+        ranges[t].end = (N*(t+1))/numThreads;
+        offsets[t] = total;
+        for (size_t i=ranges[t].start; i<ranges[t].end; i++) {
+            size_t u16len, u8len;
+            if (utf8StringAt(i, &u16len, &u8len) != NULL) {
+                if (u16len+1 > ((size_t)-1)-total) {
+                    return NO_MEMORY;
+                }
+                total += u16len+1;
+            }
+        }
+    }
+    if (total == 0) {
+        return NO_ERROR;
+    }
+
+    uint16_t* slab = allocDecodeBuffer(total);
+    if (slab == NULL) {
+        return NO_MEMORY;
+    }
+    for (size_t t=0; t<numThreads; t++) {
+        ranges[t].dest = slab + offsets[t];
+    }
+
+    pthread_t threads[kMaxDecodeThreads];
+    size_t started = 0;
+    for (size_t t=1; t<numThreads; t++) {
+        if (pthread_create(&threads[started], NULL, decodeRangeThread, &ranges[t]) != 0) {
+            decodeRange(ranges[t].start, ranges[t].end, ranges[t].dest);
+            continue;
+        }
+        started++;
+    }
+    decodeRange(ranges[0].start, ranges[0].end, ranges[0].dest);
+    for (size_t t=0; t<started; t++) {
+        pthread_join(threads[t], NULL);
+    }
+    return NO_ERROR;
+}
+
 const char* ResStringPool::string8At(size_t idx, size_t* outLen) const
 {
     if (mError == NO_ERROR && idx < mHeader->stringCount) {
@@ -640,9 +1013,10 @@ const char* ResStringPool::string8At(size_t idx, size_t* outLen) const
             if (isUTF8) {
                 const uint8_t* strings = (uint8_t*)mStrings;
                 const uint8_t* str = strings+off;
-                *outLen = decodeLength(&str);
+                decodeLength(&str);
                 size_t encLen = decodeLength(&str);
                 if ((uint32_t)(str+encLen-strings) < mStringPoolSize) {
+                    *outLen = encLen;
                     return (const char*)str;
                 } else {
                     LOGW("Bad string block: string #%d extends to %d, past end at %d\n",
@@ -658,6 +1032,50 @@ const char* ResStringPool::string8At(size_t idx, size_t* outLen) const
     return NULL;
 }
 
+String8 ResStringPool::string8ObjectAt(size_t idx) const
+{
+    size_t len;
+    const char* str8 = string8At(idx, &len);
+    if (str8 != NULL) {
+        return String8(str8, len);
+    }
+    const uint16_t* str16 = stringAt(idx, &len);
+    if (str16 != NULL) {
+        return String8(str16, len);
+    }
+    return String8();
+}
+
+bool ResStringPool::string8Equals(size_t idx, const char* str, size_t strLen) const
+{
+    size_t len;
+    const char* str8 = string8At(idx, &len);
+    if (str8 != NULL) {
+        return len == strLen && memcmp(str8, str, len) == 0;
+    }
+    if (mError != NO_ERROR || (mHeader->flags&ResStringPool_header::UTF8_FLAG) != 0) {
+        return false;
+    }
+
+    // UTF-16 pool: plain ASCII keys, which is what callers pass nearly
+    // always, compare code unit by code unit.
+    const uint16_t* str16 = stringAt(idx, &len);
+    if (str16 == NULL) {
+        return false;
+    }
+    size_t i;
+    for (i = 0; i < strLen && (str[i]&0x80) == 0; i++) {
+        if (i >= len || str16[i] != (uint8_t)str[i]) {
+            return false;
+        }
+    }
+    if (i == strLen) {
+        return len == strLen;
+    }
+    String8 tmp(str16, len);
+    return tmp.length() == strLen && memcmp(tmp.string(), str, strLen) == 0;
+}
+
 const ResStringPool_span* ResStringPool::styleAt(const ResStringPool_ref& ref) const
 {
     return styleAt(ref.index);
@@ -678,6 +1096,162 @@ const ResStringPool_span* ResStringPool::styleAt(size_t idx) const
     return NULL;
 }
 
+/*
+ * Name lookups on pools of any size go through an open-addressed hash of
+ * the raw stored bytes (UTF-8 or UTF-16, whichever the pool holds), so
+ * nothing has to be decoded to find a string.  Entries are inserted from
+ * the back of the pool; with linear probing the first match found is
+ * then the highest index, which is what the linear scan used to return.
+ */
+struct ResStringPool::string_index
+{
+    struct entry {
+        uint32_t    hash;
+        int32_t     index;      // -1 if empty
+    };
+    uint32_t        mask;
+    entry           entries[1];
+};
+
+static const size_t kMinIndexedStrings = 32;
+
+static inline uint32_t hashRawString(const void* str, size_t len)
+{
+    const uint8_t* p = (const uint8_t*)str;
+    uint32_t hash = 0;
+    while (len--) {
+        hash = hash*31 + *p++;
+    }
+    return hash;
+}
+
+const ResStringPool::string_index* ResStringPool::getStringIndex() const
+{
+    string_index* index = mIndex;
+    if (index != NULL) {
+        return index;
+    }
+
+    const size_t N = mHeader->stringCount;
+    size_t buckets = 64;
+    while (buckets < N*2) {
+        buckets <<= 1;
+    }
+    index = (string_index*)malloc(sizeof(string_index)
+            + (buckets-1)*sizeof(string_index::entry));
+    if (index == NULL) {
+        return NULL;
+    }
+    index->mask = buckets-1;
+    memset(index->entries, 0xff, buckets*sizeof(string_index::entry));
+
+    const bool isUTF8 = (mHeader->flags&ResStringPool_header::UTF8_FLAG) != 0;
+    for (ssize_t i=N-1; i>=0; i--) {
+        size_t len;
+        const void* str;
+        if (isUTF8) {
+            str = string8At(i, &len);
+        } else {
+            str = stringAt(i, &len);
+            len *= sizeof(uint16_t);
+        }
+        if (str == NULL) {
+            continue;
+        }
+        const uint32_t hash = hashRawString(str, len);
+        uint32_t slot = hash & index->mask;
+        while (index->entries[slot].index >= 0) {
+            slot = (slot+1) & index->mask;
+        }
+        index->entries[slot].hash = hash;
+        index->entries[slot].index = i;
+    }
+
+    if (!__sync_bool_compare_and_swap(&mIndex, (string_index*)NULL, index)) {
+        free(index);
+        return mIndex;
+    }
+    return index;
+}
+
+ssize_t ResStringPool::indexOfRawString(const string_index* index,
+                                        const void* str, size_t strLen) const
+{
+    const bool isUTF8 = (mHeader->flags&ResStringPool_header::UTF8_FLAG) != 0;
+    const uint32_t hash = hashRawString(str, strLen);
+    uint32_t slot = hash & index->mask;
+    for (;;) {
+        const string_index::entry& e = index->entries[slot];
+        if (e.index < 0) {
+            return NAME_NOT_FOUND;
+        }
+        if (e.hash == hash) {
+            size_t len;
+            const void* s;
+            if (isUTF8) {
+                s = string8At(e.index, &len);
+            } else {
+                s = stringAt(e.index, &len);
+                len *= sizeof(uint16_t);
+            }
+            if (s != NULL && len == strLen && memcmp(s, str, len) == 0) {
+                return e.index;
+            }
+        }
+        slot = (slot+1) & index->mask;
+    }
+}
+
+size_t ResStringPool::indicesOfString8(const char* str, size_t strLen,
+                                       uint32_t* outIndices, size_t maxIndices) const
+{
+    if (mError != NO_ERROR) {
+        return 0;
+    }
+
+    size_t count = 0;
+    const bool isUTF8 = (mHeader->flags&ResStringPool_header::UTF8_FLAG) != 0;
+    const string_index* index = (isUTF8 && mHeader->stringCount >= kMinIndexedStrings)
+            ? getStringIndex() : NULL;
+    if (index != NULL) {
+        const uint32_t hash = hashRawString(str, strLen);
+        for (uint32_t slot = hash & index->mask;
+                index->entries[slot].index >= 0 && count < maxIndices;
+                slot = (slot+1) & index->mask) {
+            const string_index::entry& e = index->entries[slot];
+            size_t len;
+            const char* s;
+            if (e.hash == hash && (s = string8At(e.index, &len)) != NULL
+                    && len == strLen && memcmp(s, str, len) == 0) {
+                outIndices[count++] = e.index;
+            }
+        }
+    } else {
+        for (size_t i=0; i<mHeader->stringCount && count < maxIndices; i++) {
+            if (string8Equals(i, str, strLen)) {
+                outIndices[count++] = i;
+            }
+        }
+    }
+    return count;
+}
+
+ssize_t ResStringPool::indexOfString8(const char* str, size_t strLen) const
+{
+    if (mError != NO_ERROR) {
+        return mError;
+    }
+    if ((mHeader->flags&ResStringPool_header::UTF8_FLAG) != 0
+            && mHeader->stringCount >= kMinIndexedStrings) {
+        const string_index* index = getStringIndex();
+        if (index != NULL) {
+            return indexOfRawString(index, str, strLen);
+        }
+    }
+    String16 str16(str, strLen);
+    return indexOfString(str16.string(), str16.size());
+}
+
 ssize_t ResStringPool::indexOfString(const uint16_t* str, size_t strLen) const
 {
     if (mError != NO_ERROR) {
@@ -686,6 +1260,23 @@ ssize_t ResStringPool::indexOfString(const uint16_t* str, size_t strLen) const
 
     size_t len;
 
+    if (mHeader->stringCount >= kMinIndexedStrings) {
+        const string_index* index = getStringIndex();
+        if (index != NULL) {
+            if ((mHeader->flags&ResStringPool_header::UTF8_FLAG) == 0) {
+                return indexOfRawString(index, str, strLen*sizeof(uint16_t));
+            }
+            char buf[256];
+            ssize_t u8len = strLen > 0 ? utf16_to_utf8_length(str, strLen) : 0;
+            if (u8len >= 0 && (size_t)u8len < sizeof(buf)) {
+                utf16_to_utf8(str, strLen, buf);
+                return indexOfRawString(index, buf, u8len);
+            }
+            String8 str8(str, strLen);
+            return indexOfRawString(index, str8.string(), str8.length());
+        }
+    }
+
     // TODO optimize searching for UTF-8 strings taking into account
     // the cache fill to determine when to convert the searched-for
     // string key to UTF-8.
@@ -749,13 +1340,14 @@ bool ResStringPool::isUTF8() const
 // --------------------------------------------------------------------
 
 ResXMLParser::ResXMLParser(const ResXMLTree& tree)
-    : mTree(tree), mEventCode(BAD_DOCUMENT)
+    : mTree(tree), mEventCode(BAD_DOCUMENT), mCurIndex(0)
 {
 }
 
 void ResXMLParser::restart()
 {
     mCurNode = NULL;
+    mCurIndex = 0;
     mEventCode = mTree.mError == NO_ERROR ? START_DOCUMENT : BAD_DOCUMENT;
 }
 const ResStringPool& ResXMLParser::getStrings() const
@@ -773,6 +1365,7 @@ ResXMLParser::event_code_t ResXMLParser::next()
     if (mEventCode == START_DOCUMENT) {
         mCurNode = mTree.mRootNode;
         mCurExt = mTree.mRootExt;
+        mCurIndex = 0;
         return (mEventCode=mTree.mRootCode);
     } else if (mEventCode >= FIRST_CHUNK_CODE) {
         return nextNode();
@@ -883,6 +1476,27 @@ const uint16_t* ResXMLParser::getElementName(size_t* outLen) const
     return id >= 0 ? mTree.mStrings.stringAt(id, outLen) : NULL;
 }
 
+const char* ResXMLParser::getElementName8(size_t* outLen) const
+{
+    int32_t id = getElementNameID();
+    return id >= 0 ? mTree.mStrings.string8At(id, outLen) : NULL;
+}
+
+bool ResXMLParser::elementNameEquals(const char* name) const
+{
+    int32_t id = getElementNameID();
+    return id >= 0 && mTree.mStrings.string8Equals(id, name, strlen(name));
+}
+
+uint32_t ResXMLParser::getElementCode() const
+{
+    const int32_t id = getElementNameID();
+    if (id < 0 || (size_t)id >= mTree.mElementCodeCount) {
+        return 0;
+    }
+    return mTree.mElementCodes[id];
+}
+
 size_t ResXMLParser::getAttributeCount() const
 {
     if (mEventCode == START_TAG) {
@@ -968,6 +1582,24 @@ const uint16_t* ResXMLParser::getAttributeStringValue(size_t idx, size_t* outLen
     return id >= 0 ? mTree.mStrings.stringAt(id, outLen) : NULL;
 }
 
+const char* ResXMLParser::getAttributeNamespace8(size_t idx, size_t* outLen) const
+{
+    int32_t id = getAttributeNamespaceID(idx);
+    return id >= 0 ? mTree.mStrings.string8At(id, outLen) : NULL;
+}
+
+const char* ResXMLParser::getAttributeName8(size_t idx, size_t* outLen) const
+{
+    int32_t id = getAttributeNameID(idx);
+    return id >= 0 ? mTree.mStrings.string8At(id, outLen) : NULL;
+}
+
+const char* ResXMLParser::getAttributeStringValue8(size_t idx, size_t* outLen) const
+{
+    int32_t id = getAttributeValueStringID(idx);
+    return id >= 0 ? mTree.mStrings.string8At(id, outLen) : NULL;
+}
+
 int32_t ResXMLParser::getAttributeDataType(size_t idx) const
 {
     if (mEventCode == START_TAG) {
@@ -1014,12 +1646,52 @@ ssize_t ResXMLParser::getAttributeValue(size_t idx, Res_value* outValue) const
     return BAD_TYPE;
 }
 
+/*
+ * Whether pool string 'idx' is 'str', given up to 'max' of its indices
+ * from indicesOfString8().  A full list may have left copies out, so
+ * an unlisted index is then compared by value.
+ */
+static inline bool matchesIndex(const ResStringPool& pool, const uint32_t* indices,
+        size_t count, size_t max, uint32_t idx, const char* str)
+{
+    for (size_t i=0; i<count; i++) {
+        if (indices[i] == idx) return true;
+    }
+    return count >= max && pool.string8Equals(idx, str, strlen(str));
+}
+
 ssize_t ResXMLParser::indexOfAttribute(const char* ns, const char* attr) const
 {
-    String16 nsStr(ns != NULL ? ns : "");
-    String16 attrStr(attr);
-    return indexOfAttribute(ns ? nsStr.string() : NULL, ns ? nsStr.size() : 0,
-                            attrStr.string(), attrStr.size());
+    if (mEventCode != START_TAG || attr == NULL) {
+        return NAME_NOT_FOUND;
+    }
+
+    ResXMLTree::attr_query query;
+    mTree.resolveAttrQuery(ns, attr, &query);
+    const ResXMLTree::attr_query* q = &query;
+    if (q->nameCount == 0 || (ns != NULL && q->nsCount == 0)) {
+        return NAME_NOT_FOUND;
+    }
+
+    const ResXMLTree_attrExt* tag = (const ResXMLTree_attrExt*)mCurExt;
+    const size_t N = dtohs(tag->attributeCount);
+    const size_t attrSize = dtohs(tag->attributeSize);
+    const uint8_t* p = ((const uint8_t*)tag) + dtohs(tag->attributeStart);
+    for (size_t i=0; i<N; i++, p+=attrSize) {
+        const ResXMLTree_attribute* a = (const ResXMLTree_attribute*)p;
+        if (!matchesIndex(mTree.mStrings, q->nameIndices, q->nameCount,
+                ResXMLTree::MAX_QUERY_INDICES, dtohl(a->name.index), attr)) {
+            continue;
+        }
+        const int32_t curNs = dtohl(a->ns.index);
+        if (ns == NULL) {
+            if (curNs < 0) return i;
+        } else if (curNs >= 0 && matchesIndex(mTree.mStrings, q->nsIndices, q->nsCount,
+                ResXMLTree::MAX_QUERY_INDICES, curNs, ns)) {
+            return i;
+        }
+    }
+    return NAME_NOT_FOUND;
 }
 
 ssize_t ResXMLParser::indexOfAttribute(const uint16_t* ns, size_t nsLen,
@@ -1050,6 +1722,46 @@ ssize_t ResXMLParser::indexOfAttribute(const uint16_t* ns, size_t nsLen,
     return NAME_NOT_FOUND;
 }
 
+size_t ResXMLParser::gatherAttributes(const uint32_t* resIds, size_t count,
+                                      ssize_t* outIndices) const
+{
+    for (size_t i=0; i<count; i++) {
+        outIndices[i] = NAME_NOT_FOUND;
+    }
+    if (mEventCode != START_TAG || count == 0) {
+        return 0;
+    }
+
+    const ResXMLTree_attrExt* tag = (const ResXMLTree_attrExt*)mCurExt;
+    const size_t N = dtohs(tag->attributeCount);
+    const size_t attrSize = dtohs(tag->attributeSize);
+    const uint8_t* p = ((const uint8_t*)tag) + dtohs(tag->attributeStart);
+    size_t found = 0;
+    for (size_t i=0; i<N && found<count; i++, p+=attrSize) {
+        const uint32_t nameIdx = dtohl(((const ResXMLTree_attribute*)p)->name.index);
+        if (nameIdx >= mTree.mNumResIds) {
+            continue;
+        }
+        const uint32_t resId = dtohl(mTree.mResIds[nameIdx]);
+        ssize_t l = 0, h = count-1;
+        while (l <= h) {
+            const ssize_t mid = l + (h-l)/2;
+            if (resIds[mid] == resId) {
+                if (outIndices[mid] < 0) {
+                    outIndices[mid] = i;
+                    found++;
+                }
+                break;
+            } else if (resIds[mid] < resId) {
+                l = mid+1;
+            } else {
+                h = mid-1;
+            }
+        }
+    }
+    return found;
+}
+
 ssize_t ResXMLParser::indexOfID() const
 {
     if (mEventCode == START_TAG) {
@@ -1083,6 +1795,17 @@ ResXMLParser::event_code_t ResXMLParser::nextNode()
         return mEventCode;
     }
 
+    if (mTree.mNodes != NULL && mCurIndex < mTree.mNodeCount) {
+        if (++mCurIndex >= mTree.mNodeCount) {
+            mCurNode = NULL;
+            return (mEventCode=mTree.mNodesEnd);
+        }
+        const ResXMLTree::node_entry& entry = mTree.mNodes[mCurIndex];
+        mCurNode = entry.node;
+        mCurExt = entry.ext;
+        return (mEventCode=entry.code);
+    }
+
     do {
         const ResXMLTree_node* next = (const ResXMLTree_node*)
             (((const uint8_t*)mCurNode) + dtohl(mCurNode->header.size));
@@ -1147,11 +1870,83 @@ void ResXMLParser::getPosition(ResXMLParser::ResXMLPosition* pos) const
     pos->curExt = mCurExt;
 }
 
-void ResXMLParser::setPosition(const ResXMLParser::ResXMLPosition& pos)
+void ResXMLParser::setPosition(const ResXMLParser::ResXMLPosition& pos)
+{
+    mEventCode = pos.eventCode;
+    mCurNode = pos.curNode;
+    mCurExt = pos.curExt;
+    if (mTree.mNodes != NULL) {
+        // A position the index does not know about falls back to
+        // walking (and validating) the nodes directly.
+        const ssize_t idx = pos.curNode != NULL ? mTree.indexOfNode(pos.curNode) : -1;
+        mCurIndex = idx >= 0 ? (size_t)idx : mTree.mNodeCount;
+    }
+}
+
+size_t ResXMLParser::getElementCount() const
+{
+    return mTree.mElements.size();
+}
+
+const ResXMLParser::ResXMLElement* ResXMLParser::getElement(size_t idx) const
+{
+    return idx < mTree.mElements.size() ? &mTree.mElements[idx] : NULL;
+}
+
+ssize_t ResXMLParser::getElementIndex() const
+{
+    if (mEventCode != START_TAG) {
+        return NAME_NOT_FOUND;
+    }
+    const Vector<ResXMLElement>& elems = mTree.mElements;
+    ssize_t lo = 0;
+    ssize_t hi = (ssize_t)elems.size() - 1;
+    while (lo <= hi) {
+        const ssize_t mid = (lo + hi) / 2;
+        const ResXMLTree_node* cur = elems[mid].node;
+        if (cur == mCurNode) {
+            return mid;
+        } else if (cur < mCurNode) {
+            lo = mid + 1;
+        } else {
+            hi = mid - 1;
+        }
+    }
+    return NAME_NOT_FOUND;
+}
+
+status_t ResXMLParser::seekToElement(size_t idx)
+{
+    if (idx >= mTree.mElements.size()) {
+        return BAD_INDEX;
+    }
+    return seekToNode(mTree.mElements[idx].node);
+}
+
+status_t ResXMLParser::seekToElementEnd(size_t idx)
+{
+    if (idx >= mTree.mElements.size()) {
+        return BAD_INDEX;
+    }
+    const ResXMLTree_node* node = mTree.mElements[idx].endNode;
+    if (node == NULL) {
+        return NAME_NOT_FOUND;
+    }
+    return seekToNode(node);
+}
+
+/*
+ * Only used with nodes recorded by the element index, which have
+ * already been validated.
+ */
+status_t ResXMLParser::seekToNode(const ResXMLTree_node* node)
 {
-    mEventCode = pos.eventCode;
-    mCurNode = pos.curNode;
-    mCurExt = pos.curExt;
+    ResXMLPosition pos;
+    pos.eventCode = (event_code_t)dtohs(node->header.type);
+    pos.curNode = node;
+    pos.curExt = ((const uint8_t*)node) + dtohs(node->header.headerSize);
+    setPosition(pos);
+    return NO_ERROR;
 }
 
 
@@ -1162,6 +1957,8 @@ static volatile int32_t gCount = 0;
 ResXMLTree::ResXMLTree()
     : ResXMLParser(*this)
     , mError(NO_INIT), mOwnedData(NULL)
+    , mNodes(NULL), mNodeCount(0), mNodesEnd(END_DOCUMENT)
+    , mElementCodes(NULL), mElementCodeCount(0)
 {
     restart();
 }
@@ -1169,6 +1966,8 @@ ResXMLTree::ResXMLTree()
 ResXMLTree::ResXMLTree(const void* data, size_t size, bool copyData)
     : ResXMLParser(*this)
     , mError(NO_INIT), mOwnedData(NULL)
+    , mNodes(NULL), mNodeCount(0), mNodesEnd(END_DOCUMENT)
+    , mElementCodes(NULL), mElementCodeCount(0)
 {
     setTo(data, size, copyData);
 }
@@ -1178,7 +1977,7 @@ ResXMLTree::~ResXMLTree()
     uninit();
 }
 
-status_t ResXMLTree::setTo(const void* data, size_t size, bool copyData)
+status_t ResXMLTree::setTo(const void* data, size_t size, bool copyData, uint32_t flags)
 {
     uninit();
     mEventCode = START_DOCUMENT;
@@ -1262,11 +2061,164 @@ status_t ResXMLTree::setTo(const void* data, size_t size, bool copyData)
 
     mError = mStrings.getError();
 
+    if (mError == NO_ERROR && (flags&(INDEX_NODES|INDEX_ELEMENTS)) != 0) {
+        mError = buildNodeIndex((flags&INDEX_ELEMENTS) != 0);
+    }
+
 done:
     restart();
     return mError;
 }
 
+status_t ResXMLTree::setElementCodes(const char* const* names, size_t count)
+{
+    if (mError != NO_ERROR) {
+        return mError;
+    }
+    if (count > 0xffff) {
+        return BAD_VALUE;
+    }
+
+    free(mElementCodes);
+    mElementCodeCount = 0;
+    mElementCodes = (uint16_t*) calloc(mStrings.size(), sizeof(uint16_t));
+    if (mElementCodes == NULL) {
+        return NO_MEMORY;
+    }
+    mElementCodeCount = mStrings.size();
+
+    // A pool normally holds each name once; allow for a few copies,
+    // and walk the whole pool for a name that has more.
+    uint32_t indices[8];
+    const size_t maxIndices = sizeof(indices)/sizeof(indices[0]);
+    for (size_t i=0; i<count; i++) {
+        const size_t len = strlen(names[i]);
+        const size_t N = mStrings.indicesOfString8(names[i], len, indices, maxIndices);
+        if (N < maxIndices) {
+            for (size_t j=0; j<N; j++) {
+                mElementCodes[indices[j]] = (uint16_t)(i+1);
+            }
+            continue;
+        }
+        for (size_t j=0; j<mElementCodeCount; j++) {
+            if (mStrings.string8Equals(j, names[i], len)) {
+                mElementCodes[j] = (uint16_t)(i+1);
+            }
+        }
+    }
+    return NO_ERROR;
+}
+
+/*
+ * Walks the whole document once, validating each node, and records
+ * every event the walk produces.  The walk stops where an ordinary
+ * traversal would; mNodesEnd remembers whether that was the end of the
+ * document or a bad node, so replays report the same thing.
+ *
+ * With 'indexElements' the same walk also fills in mElements, keeping
+ * a stack of the open elements to link parents, children and siblings.
+ */
+status_t ResXMLTree::buildNodeIndex(bool indexElements)
+{
+    size_t avail = 64;
+    node_entry* nodes = (node_entry*) malloc(avail * sizeof(node_entry));
+    if (nodes == NULL) {
+        return NO_MEMORY;
+    }
+
+    Vector<ssize_t> open;           // elements not yet closed, innermost last
+    Vector<ssize_t> lastChild;      // parallel to 'open'
+    ssize_t lastRoot = -1;
+
+    size_t count = 0;
+    restart();
+    event_code_t code = next();
+    while (code >= FIRST_CHUNK_CODE) {
+        if (count >= avail) {
+            avail *= 2;
+            node_entry* grown = (node_entry*) realloc(nodes, avail * sizeof(node_entry));
+            if (grown == NULL) {
+                free(nodes);
+                mElements.clear();
+                return NO_MEMORY;
+            }
+            nodes = grown;
+        }
+        nodes[count].node = mCurNode;
+        nodes[count].ext = mCurExt;
+        nodes[count].code = code;
+        count++;
+
+        if (indexElements && code == START_TAG) {
+            ResXMLElement elem;
+            elem.node = mCurNode;
+            elem.endNode = NULL;
+            elem.depth = open.size();
+            elem.parent = open.size() > 0 ? open.top() : -1;
+            elem.firstChild = -1;
+            elem.nextSibling = -1;
+            elem.nameID = getElementNameID();
+            elem.attributeCount = getAttributeCount();
+            const ssize_t idx = mElements.add(elem);
+
+            ssize_t& prev = open.size() > 0 ? lastChild.editTop() : lastRoot;
+            if (prev >= 0) {
+                mElements.editItemAt(prev).nextSibling = idx;
+            } else if (elem.parent >= 0) {
+                mElements.editItemAt(elem.parent).firstChild = idx;
+            }
+            prev = idx;
+            open.push(idx);
+            lastChild.push(-1);
+        } else if (indexElements && code == END_TAG && open.size() > 0) {
+            mElements.editItemAt(open.top()).endNode = mCurNode;
+            open.pop();
+            lastChild.pop();
+        }
+
+        code = nextNode();
+    }
+
+    mNodes = nodes;
+    mNodeCount = count;
+    mNodesEnd = code;
+    return NO_ERROR;
+}
+
+/*
+ * Nodes are recorded in document order, which is also address order.
+ */
+ssize_t ResXMLTree::indexOfNode(const ResXMLTree_node* node) const
+{
+    ssize_t lo = 0;
+    ssize_t hi = (ssize_t)mNodeCount - 1;
+    while (lo <= hi) {
+        const ssize_t mid = (lo + hi) / 2;
+        const ResXMLTree_node* cur = mNodes[mid].node;
+        if (cur == node) {
+            return mid;
+        } else if (cur < node) {
+            lo = mid + 1;
+        } else {
+            hi = mid - 1;
+        }
+    }
+    return NAME_NOT_FOUND;
+}
+
+status_t ResXMLTree::setTo(const sp<AssetData>& data, uint32_t flags)
+{
+    if (data == NULL) {
+        uninit();
+        return (mError=BAD_VALUE);
+    }
+    // setTo() drops the old reference, which may be this same data
+    sp<AssetData> pin(data);
+    status_t err = setTo(pin->data(), pin->size(), false, flags);
+    mPinned = pin;
+    return err;
+}
+
 status_t ResXMLTree::getError() const
 {
     return mError;
@@ -1275,14 +2227,80 @@ status_t ResXMLTree::getError() const
 void ResXMLTree::uninit()
 {
     mError = NO_INIT;
+    {
+        AutoMutex lock(mAttrQueryLock);
+        for (size_t i=0; i<mAttrQueries.size(); i++) {
+            free((void*)mAttrQueries[i].attr);
+            free((void*)mAttrQueries[i].ns);
+        }
+        mAttrQueries.clear();
+    }
+    free(mNodes);
+    mNodes = NULL;
+    mNodeCount = 0;
+    mNodesEnd = END_DOCUMENT;
+    mElements.clear();
+    free(mElementCodes);
+    mElementCodes = NULL;
+    mElementCodeCount = 0;
     mStrings.uninit();
     if (mOwnedData) {
         free(mOwnedData);
         mOwnedData = NULL;
     }
+    mPinned.clear();
     restart();
 }
 
+/*
+ * Looks up the pool indices for an attribute (ns, attr) name pair into
+ * 'outQuery'.  The first MAX_ATTR_QUERIES distinct pairs are remembered
+ * for the life of the tree (setTo() starts over), so repeated lookups
+ * cost a few strcmp()s of the short query strings and no allocation.
+ * Parsers on other threads may share the tree, so the cache is only
+ * touched under mAttrQueryLock and callers always get their own copy.
+ */
+void ResXMLTree::resolveAttrQuery(const char* ns, const char* attr,
+        attr_query* outQuery) const
+{
+    {
+        AutoMutex lock(mAttrQueryLock);
+        const size_t N = mAttrQueries.size();
+        for (size_t i=0; i<N; i++) {
+            const attr_query& q = mAttrQueries[i];
+            if (strcmp(q.attr, attr) == 0
+                    && (q.ns == ns || (q.ns != NULL && ns != NULL && strcmp(q.ns, ns) == 0))) {
+                *outQuery = q;
+                return;
+            }
+        }
+    }
+
+    outQuery->ns = ns;
+    outQuery->attr = attr;
+    outQuery->nameCount = mStrings.indicesOfString8(attr, strlen(attr),
+            outQuery->nameIndices, MAX_QUERY_INDICES);
+    outQuery->nsCount = ns != NULL
+            ? mStrings.indicesOfString8(ns, strlen(ns), outQuery->nsIndices, MAX_QUERY_INDICES)
+            : 0;
+
+    // Two threads missing on the same pair may both add it; the
+    // duplicate only costs a slot.
+    AutoMutex lock(mAttrQueryLock);
+    if (mAttrQueries.size() >= MAX_ATTR_QUERIES) {
+        return;
+    }
+    // The query strings are almost always literals; copy them anyway,
+    // since nothing says they outlive the tree.
+    attr_query q(*outQuery);
+    q.attr = strdup(attr);
+    q.ns = ns != NULL ? strdup(ns) : NULL;
+    if (q.attr == NULL || (ns != NULL && q.ns == NULL) || mAttrQueries.add(q) < 0) {
+        free((void*)q.attr);
+        free((void*)q.ns);
+    }
+}
+
 status_t ResXMLTree::validateNode(const ResXMLTree_node* node) const
 {
     const uint16_t eventCode = dtohs(node->header.type);
@@ -1384,6 +2402,7 @@ struct ResTable::Header
     ResStringPool                   values;
     uint32_t*                       resourceIDMap;
     size_t                          resourceIDMapSize;
+    sp<AssetData>                   pinned;
 };
 
 struct ResTable::Type
@@ -1771,7 +2790,7 @@ void ResTable::Theme::dumpToLog() const
 }
 
 ResTable::ResTable()
-    : mError(NO_INIT)
+    : mError(NO_INIT), mConfigSlots(NULL), mConfigSlotCount(0)
 {
     memset(&mParams, 0, sizeof(mParams));
     memset(mPackageMap, 0, sizeof(mPackageMap));
@@ -1779,7 +2798,7 @@ ResTable::ResTable()
 }
 
 ResTable::ResTable(const void* data, size_t size, void* cookie, bool copyData)
-    : mError(NO_INIT)
+    : mError(NO_INIT), mConfigSlots(NULL), mConfigSlotCount(0)
 {
     memset(&mParams, 0, sizeof(mParams));
     memset(mPackageMap, 0, sizeof(mPackageMap));
@@ -1799,13 +2818,35 @@ inline ssize_t ResTable::getResourcePackageIndex(uint32_t resID) const
     return ((ssize_t)mPackageMap[Res_GETPACKAGE(resID)+1])-1;
 }
 
+// The public add() calls pass the idmap as an opaque Asset*; unwrap it.
+static const void* idmapAssetData(const void* idmap, size_t* outSize)
+{
+    *outSize = 0;
+    if (idmap == NULL) {
+        return NULL;
+    }
+    Asset* ass = const_cast<Asset*>(reinterpret_cast<const Asset*>(idmap));
+    *outSize = ass->getLength();
+    return ass->getBuffer(true);
+}
+
 status_t ResTable::add(const void* data, size_t size, void* cookie, bool copyData,
                        const void* idmap)
 {
-    return add(data, size, cookie, NULL, copyData, reinterpret_cast<const Asset*>(idmap));
+    size_t idmapSize;
+    const void* idmapData = idmapAssetData(idmap, &idmapSize);
+    return add(data, size, cookie, NULL, copyData, idmapData, idmapSize);
 }
 
 status_t ResTable::add(Asset* asset, void* cookie, bool copyData, const void* idmap)
+{
+    size_t idmapSize;
+    const void* idmapData = idmapAssetData(idmap, &idmapSize);
+    return add(asset, cookie, idmapData, idmapSize, copyData);
+}
+
+status_t ResTable::add(Asset* asset, void* cookie, const void* idmapData,
+                       size_t idmapSize, bool copyData)
 {
     const void* data = asset->getBuffer(true);
     if (data == NULL) {
@@ -1813,7 +2854,20 @@ status_t ResTable::add(Asset* asset, void* cookie, bool copyData, const void* id
         return UNKNOWN_ERROR;
     }
     size_t size = (size_t)asset->getLength();
-    return add(data, size, cookie, asset, copyData, reinterpret_cast<const Asset*>(idmap));
+    return add(data, size, cookie, asset, copyData, idmapData, idmapSize);
+}
+
+status_t ResTable::add(const sp<AssetData>& data, void* cookie)
+{
+    if (data == NULL) {
+        return (mError=BAD_VALUE);
+    }
+    const size_t N = mHeaders.size();
+    status_t err = add(data->data(), data->size(), cookie, NULL, false, NULL, 0);
+    if (mHeaders.size() > N) {
+        mHeaders[N]->pinned = data;
+    }
+    return err;
 }
 
 status_t ResTable::add(ResTable* src)
@@ -1837,26 +2891,32 @@ status_t ResTable::add(ResTable* src)
 
     memcpy(mPackageMap, src->mPackageMap, sizeof(mPackageMap));
 
+    for (size_t i=0; i<src->mConfigs.size(); i++) {
+        status_t err = addConfiguration(src->mConfigs[i]);
+        if (err != NO_ERROR) {
+            return (mError=err);
+        }
+    }
+
     return mError;
 }
 
 status_t ResTable::add(const void* data, size_t size, void* cookie,
-                       Asset* asset, bool copyData, const Asset* idmap)
+                       Asset* asset, bool copyData, const void* idmapData,
+                       size_t idmapSize)
 {
     if (!data) return NO_ERROR;
     Header* header = new Header(this);
     header->index = mHeaders.size();
     header->cookie = cookie;
-    if (idmap != NULL) {
-        const size_t idmap_size = idmap->getLength();
-        const void* idmap_data = const_cast<Asset*>(idmap)->getBuffer(true);
-        header->resourceIDMap = (uint32_t*)malloc(idmap_size);
+    if (idmapData != NULL) {
+        header->resourceIDMap = (uint32_t*)malloc(idmapSize);
         if (header->resourceIDMap == NULL) {
             delete header;
             return (mError = NO_MEMORY);
         }
-        memcpy((void*)header->resourceIDMap, idmap_data, idmap_size);
-        header->resourceIDMapSize = idmap_size;
+        memcpy((void*)header->resourceIDMap, idmapData, idmapSize);
+        header->resourceIDMapSize = idmapSize;
     }
     mHeaders.add(header);
 
@@ -1864,7 +2924,7 @@ status_t ResTable::add(const void* data, size_t size, void* cookie,
 
     LOAD_TABLE_NOISY(
         LOGV("Adding resources to ResTable: data=%p, size=0x%x, cookie=%p, asset=%p, copy=%d "
-             "idmap=%p\n", data, size, cookie, asset, copyData, idmap));
+             "idmap=%p\n", data, size, cookie, asset, copyData, idmapData));
 
     if (copyData || notDeviceEndian) {
         header->ownedData = malloc(size);
@@ -1932,7 +2992,7 @@ status_t ResTable::add(const void* data, size_t size, void* cookie,
                 return (mError=BAD_TYPE);
             }
             uint32_t idmap_id = 0;
-            if (idmap != NULL) {
+            if (idmapData != NULL) {
                 uint32_t tmp;
                 if (getIdmapPackageId(header->resourceIDMap,
                                       header->resourceIDMapSize,
@@ -1993,6 +3053,13 @@ void ResTable::uninit()
 
     mPackageGroups.clear();
     mHeaders.clear();
+
+    mConfigs.clear();
+    free(mConfigSlots);
+    mConfigSlots = NULL;
+    mConfigSlotCount = 0;
+    mLocales.clear();
+    mLocaleKeys.clear();
 }
 
 bool ResTable::getResourceName(uint32_t resID, resource_name* outName) const
@@ -2219,6 +3286,234 @@ out:
     return rc;
 }
 
+status_t ResTable::getResourceForConfigs(uint32_t resID, const ResTable_config* configs,
+        size_t count, Res_value* outValues, ssize_t* outBlocks) const
+{
+    status_t err = findResourceForConfigs(resID, configs, count, outValues, outBlocks);
+    if (err != NO_ERROR) {
+        return err;
+    }
+
+    // References are rare in the values this is used for (labels and
+    // icons), so they are followed one configuration at a time, the way
+    // resolveReference() would.
+    for (size_t i=0; i<count; i++) {
+        int depth = 0;
+        while (outBlocks[i] >= 0 && outValues[i].dataType == Res_value::TYPE_REFERENCE
+               && outValues[i].data != 0 && depth < 20) {
+            Res_value value;
+            ssize_t block = BAD_INDEX;
+            err = findResourceForConfigs(outValues[i].data, &configs[i], 1, &value, &block);
+            if (err != NO_ERROR) {
+                if (err == BAD_INDEX) {
+                    outBlocks[i] = BAD_INDEX;
+                }
+                // leave the reference for the caller, as resolveReference() does
+                break;
+            }
+            if (block < 0) {
+                if (block == BAD_INDEX) {
+                    outBlocks[i] = BAD_INDEX;
+                }
+                break;
+            }
+            outValues[i] = value;
+            outBlocks[i] = block;
+            depth++;
+        }
+    }
+    return NO_ERROR;
+}
+
+/*
+ * getResource() for 'count' configurations at a time.  The winners are
+ * picked per package, exactly as getEntry() would pick them, and then
+ * across overlay packages as getResource() does.
+ */
+status_t ResTable::findResourceForConfigs(uint32_t resID, const ResTable_config* configs,
+        size_t count, Res_value* outValues, ssize_t* outBlocks) const
+{
+    if (mError != NO_ERROR) {
+        return mError;
+    }
+
+    const ssize_t p = getResourcePackageIndex(resID);
+    const int t = Res_GETTYPE(resID);
+    const int e = Res_GETENTRY(resID);
+
+    if (p < 0) {
+        LOGW("No known package when getting values for resource number 0x%08x", resID);
+        return BAD_INDEX;
+    }
+    if (t < 0) {
+        LOGW("No type identifier when getting values for resource number 0x%08x", resID);
+        return BAD_INDEX;
+    }
+
+    const PackageGroup* const grp = mPackageGroups[p];
+    if (grp == NULL) {
+        LOGW("Bad identifier when getting values for resource number 0x%08x", resID);
+        return BAD_INDEX;
+    }
+
+    struct config_match {
+        const Package*          package;
+        const ResTable_type*    type;
+        uint32_t                offset;
+        const Res_value*        value;
+        ResTable_config         config;
+    };
+
+    // the overall winners, then the current package's
+    config_match* best = (config_match*)calloc(count*2, sizeof(config_match));
+    if (best == NULL) {
+        return NO_MEMORY;
+    }
+    config_match* const found = best + count;
+
+    status_t err = NO_ERROR;
+    size_t ip = grp->packages.size();
+    while (ip > 0) {
+        ip--;
+        int T = t;
+        int E = e;
+
+        const Package* const package = grp->packages[ip];
+        if (package->header->resourceIDMap) {
+            uint32_t overlayResID = 0x0;
+            status_t retval = idmapLookup(package->header->resourceIDMap,
+                                          package->header->resourceIDMapSize,
+                                          resID, &overlayResID);
+            if (retval == NO_ERROR && overlayResID != 0x0) {
+                T = Res_GETTYPE(overlayResID);
+                E = Res_GETENTRY(overlayResID);
+            } else {
+                continue;
+            }
+        }
+
+        const Type* allTypes = package->getType(T);
+        if (allTypes == NULL) {
+            continue;
+        }
+        if ((size_t)E >= allTypes->entryCount) {
+            if (ip != 0) {
+                // only the base package has to have the entry
+                continue;
+            }
+            LOGW("getResourceForConfigs failing because entryIndex %d is beyond type "
+                 "entryCount %d", E, (int)allTypes->entryCount);
+            err = BAD_TYPE;
+            goto out;
+        }
+
+        memset(found, 0, count*sizeof(config_match));
+        const size_t NT = allTypes->configs.size();
+        for (size_t c=0; c<NT; c++) {
+            const ResTable_type* const thisType = allTypes->configs[c];
+            if (thisType == NULL) continue;
+
+            const uint32_t* const eindex = (const uint32_t*)
+                (((const uint8_t*)thisType) + dtohs(thisType->header.headerSize));
+            const uint32_t thisOffset = dtohl(eindex[E]);
+            if (thisOffset == ResTable_type::NO_ENTRY) {
+                continue;
+            }
+
+            ResTable_config thisConfig;
+            thisConfig.copyFromDtoH(thisType->config);
+            for (size_t i=0; i<count; i++) {
+                if (!thisConfig.match(configs[i])) {
+                    continue;
+                }
+                if (found[i].type != NULL
+                    && !thisConfig.isBetterThan(found[i].config, &configs[i])) {
+                    continue;
+                }
+                found[i].type = thisType;
+                found[i].offset = thisOffset;
+                found[i].config = thisConfig;
+            }
+        }
+
+        for (size_t i=0; i<count; i++) {
+            const ResTable_type* const type = found[i].type;
+            if (type == NULL) {
+                if (ip == 0) {
+                    // getResource() fails outright when the base package
+                    // has nothing for the configuration
+                    best[i].value = NULL;
+                }
+                continue;
+            }
+            const uint32_t typeSize = dtohl(type->header.size);
+            const uint32_t offset = found[i].offset + dtohl(type->entriesStart);
+            if (offset > (typeSize-sizeof(ResTable_entry)) || (offset&0x3) != 0) {
+                LOGW("ResTable_entry at 0x%x is not valid in type chunk of 0x%x",
+                     offset, typeSize);
+                if (ip != 0) {
+                    // a broken overlay is skipped, as getEntry() failures are
+                    continue;
+                }
+                err = BAD_TYPE;
+                goto out;
+            }
+            const ResTable_entry* const entry = (const ResTable_entry*)
+                (((const uint8_t*)type) + offset);
+            if (dtohs(entry->size) < sizeof(*entry)) {
+                LOGW("ResTable_entry size 0x%x is too small", dtohs(entry->size));
+                if (ip != 0) {
+                    continue;
+                }
+                err = BAD_TYPE;
+                goto out;
+            }
+            if ((dtohs(entry->flags)&entry->FLAG_COMPLEX) != 0) {
+                continue;
+            }
+            const uint32_t itemOffset = offset + dtohs(entry->size);
+            if (itemOffset > (typeSize-sizeof(Res_value))) {
+                LOGW("ResTable_item at %d is beyond type chunk data %d",
+                     (int)itemOffset, typeSize);
+                if (ip != 0) {
+                    continue;
+                }
+                err = BAD_TYPE;
+                goto out;
+            }
+
+            if (best[i].package != NULL &&
+                (best[i].config.isMoreSpecificThan(found[i].config)
+                 || best[i].config.diff(found[i].config) == 0)) {
+                // as in getResource(), packages are visited newest first
+                // and an identical config does not displace an overlay
+                continue;
+            }
+            best[i] = found[i];
+            best[i].package = package;
+            best[i].value = (const Res_value*)(((const uint8_t*)type) + itemOffset);
+        }
+    }
+
+    for (size_t i=0; i<count; i++) {
+        const Res_value* const value = best[i].value;
+        if (value == NULL) {
+            memset(&outValues[i], 0, sizeof(Res_value));
+            outBlocks[i] = BAD_INDEX;
+            continue;
+        }
+        outValues[i].size = dtohs(value->size);
+        outValues[i].res0 = value->res0;
+        outValues[i].dataType = value->dataType;
+        outValues[i].data = dtohl(value->data);
+        outBlocks[i] = best[i].package->header->index;
+    }
+
+out:
+    free(best);
+    return err;
+}
+
 ssize_t ResTable::resolveReference(Res_value* value, ssize_t blockIndex,
         uint32_t* outLastRef, uint32_t* inoutTypeSpecFlags,
         ResTable_config* outConfig) const
@@ -3857,59 +5152,129 @@ void* ResTable::getTableCookie(size_t index) const
     return mHeaders[index]->cookie;
 }
 
+/*
+ * Every field that compare() looks at, folded together.  Equal configs
+ * hash equally; the words are mixed one at a time so that configs that
+ * differ in a single small field still spread out.
+ */
+static uint32_t hashConfig(const ResTable_config& config)
+{
+    const uint32_t words[] = {
+        config.imsi, config.locale, config.screenType, config.input,
+        config.screenSize, config.version, config.screenConfig, config.screenSizeDp
+    };
+    uint32_t hash = 0;
+    for (size_t i=0; i<sizeof(words)/sizeof(words[0]); i++) {
+        hash = (hash ^ words[i]) * 0x9e3779b1;
+        hash ^= hash >> 15;
+    }
+    return hash;
+}
+
+/*
+ * The locale as getLocale() would print it, packed into a word: no
+ * language means no locale, and the country only counts with one.
+ */
+static uint32_t packLocale(const ResTable_config& config)
+{
+    if (config.language[0] == 0) {
+        return 0;
+    }
+    uint32_t key = ((uint8_t)config.language[0] << 24) | ((uint8_t)config.language[1] << 16);
+    if (config.country[0] != 0) {
+        key |= ((uint8_t)config.country[0] << 8) | (uint8_t)config.country[1];
+    }
+    return key;
+}
+
+/*
+ * Records a type chunk's configuration, and its locale, if they have
+ * not been seen before.  Tables hold a handful of distinct configs
+ * spread over thousands of chunks, so this is usually one hash and one
+ * compare().
+ */
+status_t ResTable::addConfiguration(const ResTable_config& config)
+{
+    if ((mConfigs.size() + 1) * 4 > mConfigSlotCount * 3) {
+        // double the table, keeping load below 3/4
+        const size_t newCount = mConfigSlotCount == 0 ? 64 : mConfigSlotCount * 2;
+        uint32_t* newSlots = (uint32_t*)calloc(newCount, sizeof(uint32_t));
+        if (newSlots == NULL) {
+            LOGE("Unable to grow configuration table to %d slots\n", (int)newCount);
+            return NO_MEMORY;
+        }
+        for (size_t i=0; i<mConfigs.size(); i++) {
+            size_t slot = hashConfig(mConfigs[i]) & (newCount-1);
+            while (newSlots[slot] != 0) {
+                slot = (slot + 1) & (newCount-1);
+            }
+            newSlots[slot] = i + 1;
+        }
+        free(mConfigSlots);
+        mConfigSlots = newSlots;
+        mConfigSlotCount = newCount;
+    }
+
+    const size_t mask = mConfigSlotCount - 1;
+    size_t slot = hashConfig(config) & mask;
+    while (mConfigSlots[slot] != 0) {
+        if (mConfigs[mConfigSlots[slot]-1].compare(config) == 0) {
+            return NO_ERROR;
+        }
+        slot = (slot + 1) & mask;
+    }
+    mConfigSlots[slot] = mConfigs.add(config) + 1;
+
+    const uint32_t key = packLocale(config);
+    if (mLocaleKeys.indexOf(key) < 0) {
+        mLocaleKeys.add(key);
+        char locale[6];
+        config.getLocale(locale);
+        mLocales.add(String8(locale));
+    }
+    return NO_ERROR;
+}
+
 void ResTable::getConfigurations(Vector<ResTable_config>* configs) const
 {
-    const size_t I = mPackageGroups.size();
+    if (configs->size() == 0) {
+        *configs = mConfigs;
+        return;
+    }
+    // only insert unique
+    const size_t I = mConfigs.size();
+    const size_t M = configs->size();
     for (size_t i=0; i<I; i++) {
-        const PackageGroup* packageGroup = mPackageGroups[i];
-        const size_t J = packageGroup->packages.size();
-        for (size_t j=0; j<J; j++) {
-            const Package* package = packageGroup->packages[j];
-            const size_t K = package->types.size();
-            for (size_t k=0; k<K; k++) {
-                const Type* type = package->types[k];
-                if (type == NULL) continue;
-                const size_t L = type->configs.size();
-                for (size_t l=0; l<L; l++) {
-                    const ResTable_type* config = type->configs[l];
-                    const ResTable_config* cfg = &config->config;
-                    // only insert unique
-                    const size_t M = configs->size();
-                    size_t m;
-                    for (m=0; m<M; m++) {
-                        if (0 == (*configs)[m].compare(*cfg)) {
-                            break;
-                        }
-                    }
-                    // if we didn't find it
-                    if (m == M) {
-                        configs->add(*cfg);
-                    }
-                }
+        size_t m;
+        for (m=0; m<M; m++) {
+            if (0 == (*configs)[m].compare(mConfigs[i])) {
+                break;
             }
         }
+        // if we didn't find it
+        if (m == M) {
+            configs->add(mConfigs[i]);
+        }
     }
 }
 
 void ResTable::getLocales(Vector<String8>* locales) const
 {
-    Vector<ResTable_config> configs;
-    LOGV("calling getConfigurations");
-    getConfigurations(&configs);
-    LOGV("called getConfigurations size=%d", (int)configs.size());
-    const size_t I = configs.size();
+    if (locales->size() == 0) {
+        *locales = mLocales;
+        return;
+    }
+    const size_t I = mLocales.size();
+    const size_t J = locales->size();
     for (size_t i=0; i<I; i++) {
-        char locale[6];
-        configs[i].getLocale(locale);
-        const size_t J = locales->size();
         size_t j;
         for (j=0; j<J; j++) {
-            if (0 == strcmp(locale, (*locales)[j].string())) {
+            if (mLocales[i] == (*locales)[j]) {
                 break;
             }
         }
         if (j == J) {
-            locales->add(String8(locale));
+            locales->add(mLocales[i]);
         }
     }
 }
@@ -4290,6 +5655,10 @@ status_t ResTable::parsePackage(const ResTable_package* const pkg,
                       thisConfig.screenWidthDp,
                       thisConfig.screenHeightDp));
             t->configs.add(type);
+            status_t err = addConfiguration(type->config);
+            if (err != NO_ERROR) {
+                return (mError=err);
+            }
         } else {
             status_t err = validate_chunk(chunk, sizeof(ResChunk_header),
                                           endPos, "ResTable_package:unknown");
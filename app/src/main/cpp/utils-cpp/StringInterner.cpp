@@ -0,0 +1,235 @@
+/*
+ * Copyright (C) 2026 The aapt Authors
+ *
+ * Licensed under the Apache License, Version 2.0 (the "License");
+ * you may not use this file except in compliance with the License.
+ * You may obtain a copy of the License at
+ *
+ *      http://www.apache.org/licenses/LICENSE-2.0
+ *
+ * Unless required by applicable law or agreed to in writing, software
+ * distributed under the License is distributed on an "AS IS" BASIS,
+ * WITHOUT WARRANTIES OR CONDITIONS OF ANY KIND, either express or implied.
+ * See the License for the specific language governing permissions and
+ * limitations under the License.
+ */
+
+//
+// String interning.
+//
+
+#define LOG_TAG "interner"
+#include "../fakeLog.h"
+
+#include "../utils/StringInterner.h"
+#include "../utils/ResourceTypes.h"
+#include "../utils/String8.h"
+
+#include <stdlib.h>
+#include <string.h>
+
+using namespace android;
+
+/*
+ * Interned names are packed into chunks; a chunk is never reallocated,
+ * so pointers handed out by string() stay valid.
+ */
+struct StringInterner::name_chunk {
+    name_chunk* next;
+    size_t      used;
+    size_t      avail;
+    char        data[1];
+};
+
+static const size_t kNameChunkSize = 16*1024;
+
+static inline uint32_t hashName(const char* str, size_t len)
+{
+    uint32_t hash = 0;
+    while (len--) {
+        hash = hash*31 + (uint8_t)*str++;
+    }
+    return hash;
+}
+
+StringInterner::StringInterner(void)
+    : mTable(NULL), mTableMask(0), mChunks(NULL)
+{
+    atom_info none = { NULL, 0, 0 };
+    mAtoms.add(none);
+    rehash(256);
+}
+
+StringInterner::~StringInterner(void)
+{
+    free(mTable);
+    while (mChunks != NULL) {
+        name_chunk* next = mChunks->next;
+        free(mChunks);
+        mChunks = next;
+    }
+    for (size_t i = 0; i < mPools.size(); i++) {
+        free(mPools[i].atoms);
+    }
+}
+
+const char* StringInterner::copyName(const char* str, size_t len)
+{
+    name_chunk* chunk = mChunks;
+    if (chunk == NULL || chunk->avail - chunk->used < len+1) {
+        size_t avail = len+1 > kNameChunkSize ? len+1 : kNameChunkSize;
+        chunk = (name_chunk*) malloc(sizeof(name_chunk) + avail);
+        if (chunk == NULL) {
+            return NULL;
+        }
+        chunk->used = 0;
+        chunk->avail = avail;
+        chunk->next = mChunks;
+        mChunks = chunk;
+    }
+    char* dst = chunk->data + chunk->used;
+    memcpy(dst, str, len);
+    dst[len] = '\0';
+    chunk->used += len+1;
+    return dst;
+}
+
+status_t StringInterner::rehash(size_t buckets)
+{
+    uint32_t* table = (uint32_t*) calloc(buckets, sizeof(uint32_t));
+    if (table == NULL) {
+        LOGW("Unable to grow string interner to %d buckets\n", (int) buckets);
+        return NO_MEMORY;
+    }
+    const size_t mask = buckets-1;
+    for (size_t atom = 1; atom < mAtoms.size(); atom++) {
+        size_t slot = mAtoms[atom].hash & mask;
+        while (table[slot] != NO_ATOM) {
+            slot = (slot+1) & mask;
+        }
+        table[slot] = atom;
+    }
+    free(mTable);
+    mTable = table;
+    mTableMask = mask;
+    return NO_ERROR;
+}
+
+uint32_t StringInterner::find(const char* str, size_t len) const
+{
+    if (mTable == NULL) {
+        return NO_ATOM;
+    }
+    const uint32_t hash = hashName(str, len);
+    size_t slot = hash & mTableMask;
+    uint32_t atom;
+    while ((atom = mTable[slot]) != NO_ATOM) {
+        const atom_info& info = mAtoms[atom];
+        if (info.hash == hash && info.len == len && memcmp(info.str, str, len) == 0) {
+            return atom;
+        }
+        slot = (slot+1) & mTableMask;
+    }
+    return NO_ATOM;
+}
+
+uint32_t StringInterner::intern(const char* str, size_t len)
+{
+    uint32_t atom = find(str, len);
+    if (atom != NO_ATOM) {
+        return atom;
+    }
+
+    // keep the table at most 3/4 full; if it can't grow, don't add to
+    // it, or the probes in find() could run forever
+    if (mTable == NULL || (mAtoms.size()+1)*4 > (mTableMask+1)*3) {
+        if (rehash(mTable == NULL ? 256 : (mTableMask+1)*2) != NO_ERROR) {
+            return NO_ATOM;
+        }
+    }
+
+    atom_info info;
+    info.str = copyName(str, len);
+    if (info.str == NULL) {
+        return NO_ATOM;
+    }
+    info.len = len;
+    info.hash = hashName(str, len);
+    atom = mAtoms.add(info);
+
+    size_t slot = info.hash & mTableMask;
+    while (mTable[slot] != NO_ATOM) {
+        slot = (slot+1) & mTableMask;
+    }
+    mTable[slot] = atom;
+    return atom;
+}
+
+uint32_t StringInterner::intern(const char* str)
+{
+    return intern(str, strlen(str));
+}
+
+const char* StringInterner::string(uint32_t atom, size_t* outLen) const
+{
+    if (atom == NO_ATOM || atom >= mAtoms.size()) {
+        return NULL;
+    }
+    if (outLen != NULL) {
+        *outLen = mAtoms[atom].len;
+    }
+    return mAtoms[atom].str;
+}
+
+uint32_t StringInterner::atomAt(const ResStringPool& pool, ssize_t idx)
+{
+    if (idx < 0 || (size_t)idx >= pool.size()) {
+        return NO_ATOM;
+    }
+
+    pool_atoms* pa = NULL;
+    for (size_t i = 0; i < mPools.size(); i++) {
+        if (mPools[i].pool == &pool) {
+            pa = &mPools.editItemAt(i);
+            break;
+        }
+    }
+    if (pa == NULL) {
+        pool_atoms entry;
+        entry.pool = &pool;
+        entry.count = pool.size();
+        entry.atoms = (uint32_t*) calloc(entry.count, sizeof(uint32_t));
+        if (entry.atoms == NULL) {
+            return NO_ATOM;
+        }
+        pa = &mPools.editItemAt(mPools.add(entry));
+    }
+    if ((size_t)idx >= pa->count) {
+        return NO_ATOM;
+    }
+
+    uint32_t atom = pa->atoms[idx];
+    if (atom == NO_ATOM) {
+        size_t len;
+        const char* str8 = pool.string8At(idx, &len);
+        if (str8 != NULL) {
+            atom = intern(str8, len);
+        } else {
+            String8 str(pool.string8ObjectAt(idx));
+            atom = intern(str.string(), str.length());
+        }
+        pa->atoms[idx] = atom;
+    }
+    return atom;
+}
+
+void StringInterner::forgetPool(const ResStringPool& pool)
+{
+    for (size_t i = 0; i < mPools.size(); i++) {
+        if (mPools[i].pool == &pool) {
+            free(mPools[i].atoms);
+            mPools.removeAt(i);
+            return;
+        }
+    }
+}
@@ -17,6 +17,14 @@
 #include "../utils/Unicode.h"
 
 #include <stddef.h>
+#include <string.h>
+
+#if defined(__SSE2__)
+# include <emmintrin.h>
+#elif defined(__ARM_NEON__) || defined(__ARM_NEON)
+# include <arm_neon.h>
+# define UNICODE_USE_NEON 1
+#endif
 
 #ifdef HAVE_WINSOCK
 # undef  nhtol
@@ -205,6 +213,131 @@ void utf32_to_utf8(const char32_t* src, size_t src_len, char* dst)
     *cur = '\0';
 }
 
+// --------------------------------------------------------------------------
+// ASCII runs
+// --------------------------------------------------------------------------
+
+/*
+ * Nearly all resource strings are plain ASCII, which maps one code unit
+ * to one code unit in either direction.  These helpers consume the
+ * leading ASCII run of a buffer a vector (or a word) at a time and leave
+ * everything from the first non-ASCII unit to the per-codepoint loops,
+ * so results and validation are exactly what the slow path produces.
+ *
+ * The SIMD variant is picked at compile time; the armeabi build, which
+ * has no NEON, gets the word-at-a-time fallback.
+ */
+
+// Returns the length of the leading run of bytes below 0x80.
+static inline size_t utf8_ascii_run(const uint8_t* src, size_t len)
+{
+    size_t i = 0;
+#if defined(__SSE2__)
+    for (; i + 16 <= len; i += 16) {
+        __m128i v = _mm_loadu_si128((const __m128i*)(src + i));
+        if (_mm_movemask_epi8(v) != 0) break;
+    }
+#elif defined(UNICODE_USE_NEON)
+    for (; i + 16 <= len; i += 16) {
+        uint8x16_t v = vld1q_u8(src + i);
+        uint8x8_t m = vorr_u8(vget_low_u8(v), vget_high_u8(v));
+        if ((vget_lane_u64(vreinterpret_u64_u8(m), 0) & 0x8080808080808080ULL) != 0) break;
+    }
+#else
+    for (; i + 4 <= len; i += 4) {
+        uint32_t w;
+        memcpy(&w, src + i, sizeof(w));
+        if ((w & 0x80808080) != 0) break;
+    }
+#endif
+    while (i < len && src[i] < 0x80) i++;
+    return i;
+}
+
+// Widens the leading ASCII run of src into dst; returns its length.
+static inline size_t utf8_ascii_widen(const uint8_t* src, size_t len, uint16_t* dst)
+{
+    size_t i = 0;
+#if defined(__SSE2__)
+    const __m128i zero = _mm_setzero_si128();
+    for (; i + 16 <= len; i += 16) {
+        __m128i v = _mm_loadu_si128((const __m128i*)(src + i));
+        if (_mm_movemask_epi8(v) != 0) break;
+        _mm_storeu_si128((__m128i*)(dst + i), _mm_unpacklo_epi8(v, zero));
+        _mm_storeu_si128((__m128i*)(dst + i + 8), _mm_unpackhi_epi8(v, zero));
+    }
+#elif defined(UNICODE_USE_NEON)
+    for (; i + 16 <= len; i += 16) {
+        uint8x16_t v = vld1q_u8(src + i);
+        uint8x8_t m = vorr_u8(vget_low_u8(v), vget_high_u8(v));
+        if ((vget_lane_u64(vreinterpret_u64_u8(m), 0) & 0x8080808080808080ULL) != 0) break;
+        vst1q_u16(dst + i, vmovl_u8(vget_low_u8(v)));
+        vst1q_u16(dst + i + 8, vmovl_u8(vget_high_u8(v)));
+    }
+#endif
+    for (; i < len && src[i] < 0x80; i++) {
+        dst[i] = src[i];
+    }
+    return i;
+}
+
+// Returns the length of the leading run of code units below 0x80.
+static inline size_t utf16_ascii_run(const uint16_t* src, size_t len)
+{
+    size_t i = 0;
+#if defined(__SSE2__)
+    const __m128i high = _mm_set1_epi16((short)0xFF80);
+    const __m128i zero = _mm_setzero_si128();
+    for (; i + 8 <= len; i += 8) {
+        __m128i v = _mm_loadu_si128((const __m128i*)(src + i));
+        if (_mm_movemask_epi8(_mm_cmpeq_epi16(_mm_and_si128(v, high), zero)) != 0xFFFF) break;
+    }
+#elif defined(UNICODE_USE_NEON)
+    const uint16x8_t high = vdupq_n_u16(0xFF80);
+    for (; i + 8 <= len; i += 8) {
+        uint16x8_t v = vandq_u16(vld1q_u16(src + i), high);
+        uint16x4_t m = vorr_u16(vget_low_u16(v), vget_high_u16(v));
+        if (vget_lane_u64(vreinterpret_u64_u16(m), 0) != 0) break;
+    }
+#else
+    for (; i + 2 <= len; i += 2) {
+        uint32_t w;
+        memcpy(&w, src + i, sizeof(w));
+        if ((w & 0xFF80FF80) != 0) break;
+    }
+#endif
+    while (i < len && src[i] < 0x80) i++;
+    return i;
+}
+
+// Narrows the leading ASCII run of src into dst; returns its length.
+static inline size_t utf16_ascii_narrow(const uint16_t* src, size_t len, char* dst)
+{
+    size_t i = 0;
+#if defined(__SSE2__)
+    const __m128i high = _mm_set1_epi16((short)0xFF80);
+    const __m128i zero = _mm_setzero_si128();
+    for (; i + 8 <= len; i += 8) {
+        __m128i v = _mm_loadu_si128((const __m128i*)(src + i));
+        if (_mm_movemask_epi8(_mm_cmpeq_epi16(_mm_and_si128(v, high), zero)) != 0xFFFF) break;
+        _mm_storel_epi64((__m128i*)(dst + i), _mm_packus_epi16(v, v));
+    }
+#elif defined(UNICODE_USE_NEON)
+    const uint16x8_t high = vdupq_n_u16(0xFF80);
+    for (; i + 8 <= len; i += 8) {
+        uint16x8_t v = vld1q_u16(src + i);
+        uint16x8_t h = vandq_u16(v, high);
+        uint16x4_t m = vorr_u16(vget_low_u16(h), vget_high_u16(h));
+        if (vget_lane_u64(vreinterpret_u64_u16(m), 0) != 0) break;
+        vst1_u8((uint8_t*)(dst + i), vmovn_u16(v));
+    }
+#endif
+    for (; i < len && src[i] < 0x80; i++) {
+        dst[i] = (char)src[i];
+    }
+    return i;
+}
+
 // --------------------------------------------------------------------------
 // UTF-16
 // --------------------------------------------------------------------------
@@ -340,6 +473,12 @@ void utf16_to_utf8(const uint16_t* src, size_t src_len, char* dst)
     const uint16_t* const end_utf16 = src + src_len;
     char *cur = dst;
     while (cur_utf16 < end_utf16) {
+        if (*cur_utf16 < 0x80) {
+            size_t n = utf16_ascii_narrow(cur_utf16, end_utf16 - cur_utf16, cur);
+            cur_utf16 += n;
+            cur += n;
+            continue;
+        }
         char32_t utf32;
         // surrogate pairs
         if ((*cur_utf16 & 0xFC00) == 0xD800) {
@@ -412,6 +551,12 @@ ssize_t utf16_to_utf8_length(const uint16_t *src, size_t src_len)
     size_t ret = 0;
     const uint16_t* const end = src + src_len;
     while (src < end) {
+        if (*src < 0x80) {
+            size_t n = utf16_ascii_run(src, end - src);
+            ret += n;
+            src += n;
+            continue;
+        }
         if ((*src & 0xFC00) == 0xD800 && (src + 1) < end
                 && (*++src & 0xFC00) == 0xDC00) {
             // surrogate pairs are always 4 bytes.
@@ -524,6 +669,12 @@ ssize_t utf8_to_utf16_length(const uint8_t* u8str, size_t u8len)
     /* Validate that the UTF-8 is the correct len */
     size_t u16measuredLen = 0;
     while (u8cur < u8end) {
+        if (*u8cur < 0x80) {
+            size_t n = utf8_ascii_run(u8cur, u8end - u8cur);
+            u16measuredLen += n;
+            u8cur += n;
+            continue;
+        }
         u16measuredLen++;
         int u8charLen = utf8_codepoint_len(*u8cur);
         uint32_t codepoint = utf8_to_utf32_codepoint(u8cur, u8charLen);
@@ -549,6 +700,12 @@ uint16_t* utf8_to_utf16_no_null_terminator(const uint8_t* u8str, size_t u8len, u
     uint16_t* u16cur = u16str;
 
     while (u8cur < u8end) {
+        if (*u8cur < 0x80) {
+            size_t n = utf8_ascii_widen(u8cur, u8end - u8cur, u16cur);
+            u8cur += n;
+            u16cur += n;
+            continue;
+        }
         size_t u8len = utf8_codepoint_len(*u8cur);
         uint32_t codepoint = utf8_to_utf32_codepoint(u8cur, u8len);
 
@@ -30,6 +30,13 @@
 #include <errno.h>
 #include <assert.h>
 
+/*
+ * posix_fadvise() only showed up in bionic at API level 21.
+ */
+#if defined(POSIX_FADV_WILLNEED) && (!defined(__ANDROID_API__) || __ANDROID_API__ >= 21)
+#  define HAVE_POSIX_FADVISE 1
+#endif
+
 #if HAVE_PRINTF_ZD
 #  define ZD "%zd"
 #  define ZD_TYPE ssize_t
@@ -312,6 +319,13 @@ bool ZipFileRO::mapCentralDirectory(void)
         return false;
     }
 
+    /*
+     * parseZipArchive() is about to walk every entry, and the CD sits at
+     * the end of the file where read-ahead from the EOCD search doesn't
+     * help.  Ask for all of it up front.
+     */
+    mDirectoryMap->advise(FileMap::WILLNEED);
+
     mNumEntries = numEntries;
     mDirectoryOffset = dirOffset;
 
@@ -661,6 +675,137 @@ FileMap* ZipFileRO::createEntryFileMap(ZipEntryRO entry) const
     return newMap;
 }
 
+/*
+ * Byte range covered by one entry, from its local file header through
+ * the end of its (possibly compressed) data.
+ */
+typedef struct PrefetchRange {
+    off64_t start;
+    off64_t end;
+} PrefetchRange;
+
+static int comparePrefetchRange(const void* lhs, const void* rhs)
+{
+    const PrefetchRange* l = (const PrefetchRange*) lhs;
+    const PrefetchRange* r = (const PrefetchRange*) rhs;
+    if (l->start < r->start)
+        return -1;
+    return l->start > r->start ? 1 : 0;
+}
+
+void ZipFileRO::prefetchEntries(const ZipEntryRO* entries, int count) const
+{
+    /*
+     * Gaps smaller than this are read through rather than seeked over;
+     * it's cheaper than another random read on a cold cache.  We also cap
+     * the total so a stray huge entry doesn't turn a hint into a full scan.
+     */
+    static const off64_t kMaxGap = 64 * 1024;
+    static const off64_t kMaxPrefetch = 8 * 1024 * 1024;
+
+    if (count <= 0)
+        return;
+
+    PrefetchRange* ranges = (PrefetchRange*) malloc(count * sizeof(PrefetchRange));
+    if (ranges == NULL)
+        return;
+
+    /*
+     * Everything we need is in the central directory, so this doesn't
+     * touch the file.  The CDE's extra field length may differ from the
+     * LFH's, but it's close enough for a read-ahead.
+     */
+    int numRanges = 0;
+    for (int i = 0; i < count; i++) {
+        const int ent = entryToIndex(entries[i]);
+        if (ent < 0)
+            continue;
+
+        const unsigned char* ptr =
+            (const unsigned char*) mHashTable[ent].name - kCDELen;
+        off64_t start = get4LE(ptr + kCDELocalOffset);
+        off64_t end = start + kLFHLen + get2LE(ptr + kCDENameLen)
+            + get2LE(ptr + kCDEExtraLen) + get4LE(ptr + kCDECompLen);
+        if (start >= mDirectoryOffset)
+            continue;
+        if (end > mDirectoryOffset)
+            end = mDirectoryOffset;
+
+        ranges[numRanges].start = start;
+        ranges[numRanges].end = end;
+        numRanges++;
+    }
+
+    qsort(ranges, numRanges, sizeof(PrefetchRange), comparePrefetchRange);
+
+    /* coalesce neighbours in place */
+    int numRuns = 0;
+    for (int i = 0; i < numRanges; i++) {
+        if (numRuns > 0 && ranges[i].start <= ranges[numRuns-1].end + kMaxGap) {
+            if (ranges[i].end > ranges[numRuns-1].end)
+                ranges[numRuns-1].end = ranges[i].end;
+        } else {
+            ranges[numRuns++] = ranges[i];
+        }
+    }
+
+    unsigned char* buf = NULL;
+    const size_t kBufSize = 64 * 1024;
+    off64_t budget = kMaxPrefetch;
+
+    for (int i = 0; i < numRuns && budget > 0; i++) {
+        off64_t len = ranges[i].end - ranges[i].start;
+        if (len > budget)
+            len = budget;
+        budget -= len;
+
+        LOGV("Prefetching %ld bytes at %ld from %s\n",
+            (long) len, (long) ranges[i].start, mFileName);
+
+#if HAVE_POSIX_FADVISE
+        /* asynchronous, and doesn't copy anything */
+        if (posix_fadvise(mFd, ranges[i].start, len, POSIX_FADV_WILLNEED) == 0)
+            continue;
+#endif
+
+        /*
+         * One sequential pass over the run.  We don't want the data, we
+         * want it in the page cache for the maps created afterwards.
+         */
+        if (buf == NULL) {
+            buf = (unsigned char*) malloc(kBufSize);
+            if (buf == NULL)
+                break;
+        }
+
+        AutoMutex _l(mFdLock);
+
+        if (lseek64(mFd, ranges[i].start, SEEK_SET) != ranges[i].start)
+            break;
+        while (len > 0) {
+            size_t want = len < (off64_t) kBufSize ? (size_t) len : kBufSize;
+            ssize_t actual = TEMP_FAILURE_RETRY(read(mFd, buf, want));
+            if (actual <= 0)
+                break;
+            len -= actual;
+        }
+    }
+
+    free(buf);
+    free(ranges);
+}
+
+void ZipFileRO::releasePages(void) const
+{
+    if (mDirectoryMap != NULL)
+        mDirectoryMap->advise(FileMap::DONTNEED);
+
+#if HAVE_POSIX_FADVISE
+    if (mFd >= 0)
+        (void) posix_fadvise(mFd, 0, 0, POSIX_FADV_DONTNEED);
+#endif
+}
+
 /*
  * Uncompress an entry, in its entirety, into the provided output buffer.
  *
@@ -26,6 +26,7 @@
 
 #include "../utils/Errors.h"
 #include "../utils/FileMap.h"
+#include "../utils/RefBase.h"
 #include "../utils/String8.h"
 
 namespace android {
@@ -201,6 +202,42 @@ private:
     Asset*		mPrev;
 };
 
+/*
+ * The whole contents of an Asset, kept alive by reference counting.
+ *
+ * The AssetData owns the Asset it was created from, and with it the
+ * FileMap or inflated buffer that data() points into.  Anything parsed
+ * in place over those bytes (ResXMLTree, ResTable) can hold a reference
+ * instead of relying on the caller to keep the asset open for long
+ * enough, and can be shared between threads without copying.  The
+ * bytes are never written after creation.
+ */
+class AssetData : public LightRefBase<AssetData> {
+public:
+    /*
+     * Takes ownership of "asset" and fetches its word-aligned buffer.
+     * Returns NULL, having deleted the asset, if that fails.
+     */
+    static sp<AssetData> create(Asset* asset);
+
+    const void* data(void) const { return mData; }
+    size_t size(void) const { return mSize; }
+
+private:
+    friend class LightRefBase<AssetData>;
+
+    AssetData(Asset* asset, const void* data, size_t size);
+    ~AssetData(void);
+
+    /* these operations are not implemented */
+    AssetData(const AssetData& src);
+    AssetData& operator=(const AssetData& src);
+
+    Asset*      mAsset;
+    const void* mData;
+    size_t      mSize;
+};
+
 
 /*
  * ===========================================================================
@@ -217,6 +254,13 @@ public:
     _FileAsset(void);
     virtual ~_FileAsset(void);
 
+    /*
+     * To support getBuffer() we either need to read the entire thing into
+     * a buffer or memory-map it.  For small files it's probably best to
+     * just read them in.
+     */
+    enum { kReadVsMapThreshold = 4096 };
+
     /*
      * Use a piece of an already-open file.
      *
@@ -250,13 +294,6 @@ private:
     FILE*       mFp;            // for read/seek
     char*       mFileName;      // for opening
 
-    /*
-     * To support getBuffer() we either need to read the entire thing into
-     * a buffer or memory-map it.  For small files it's probably best to
-     * just read them in.
-     */
-    enum { kReadVsMapThreshold = 4096 };
-
     FileMap*    mMap;           // for memory map
     unsigned char* mBuf;        // for read
     
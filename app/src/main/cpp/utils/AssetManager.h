@@ -51,6 +51,7 @@ namespace android {
 
 class Asset;        // fwd decl for things that include Asset.h first
 class ResTable;
+class ResXMLTree;
 struct ResTable_config;
 
 /*
@@ -79,6 +80,14 @@ public:
     virtual ~AssetManager(void);
 
     static int32_t getGlobalCount();
+
+    /*
+     * When set, each Zip archive asks the kernel to drop its pages from
+     * the page cache once the last AssetManager using it goes away.  Off
+     * by default; turn it on when scanning lots of packages once each so
+     * they don't push everything else out of the cache.
+     */
+    static void setReleasePagesOnClose(bool release);
     
     /*                                                                       
      * Add a new source for assets.  This can be called multiple times to
@@ -93,6 +102,29 @@ public:
      */
     bool addAssetPath(const String8& path, void** cookie);
 
+    /*
+     * Add an overlay package on top of the asset path named by
+     * "targetCookie".  The idmap that maps the target's resource IDs onto
+     * the overlay's is computed in memory with ResTable::createIdmap and
+     * kept with the open overlay archive; nothing is read from or written
+     * to the idmap cache directory.
+     *
+     * Both paths must be Zip archives.  Returns "true" on success.
+     */
+    bool addOverlayPath(const String8& overlayPath, void* targetCookie,
+        void** cookie);
+
+    /*
+     * Analysis mode is for looking at packages that aren't installed,
+     * e.g. on a build or scanning server.  It turns off the discovery of
+     * /vendor/overlay packages for /system/framework paths, and with it
+     * all idmap file I/O.  Overlays can still be supplied explicitly with
+     * addOverlayPath().
+     *
+     * Set this before adding any asset paths.
+     */
+    void setAnalysisMode(bool analysisMode);
+
     /*                                                                       
      * Convenience for adding the standard system assets.  Uses the
      * ANDROID_ROOT environment variable to find them.
@@ -160,6 +192,64 @@ public:
      */
     Asset* openNonAsset(void* cookie, const char* fileName, AccessMode mode);
 
+    /*
+     * Open several non-asset files from the resource set named by the
+     * cookie in one go.  For a Zip archive the entries are looked up
+     * first and their data is read in local-header order as one coalesced
+     * pass, so a cold cache sees a sequential read instead of one random
+     * read per file.  With ACCESS_BUFFER the buffers are expanded before
+     * returning.
+     *
+     * "outAssets[i]" is set to NULL for names that weren't found.  Returns
+     * the number of assets opened.
+     */
+    size_t openNonAssets(void* cookie, const char* const* fileNames,
+        size_t count, AccessMode mode, Asset** outAssets);
+
+    /*
+     * The coalesced read from openNonAssets() on its own.  Use this ahead
+     * of getResources()/openNonAsset() to bring in the manifest and the
+     * resource table together.
+     */
+    void prefetchNonAssets(void* cookie, const char* const* fileNames,
+        size_t count);
+
+    /*
+     * One compiled XML file opened by openXmlTrees().  The tree points
+     * into the asset's buffer, so they are released together by
+     * closeXmlTrees().
+     */
+    struct xml_file
+    {
+        const char*     fileName;
+        Asset*          asset;
+        ResXMLTree*     tree;
+        status_t        error;
+    };
+
+    /*
+     * Called on a worker thread for each file that parsed.  The resource
+     * table is shared by all workers and must only be read.
+     */
+    typedef status_t (*xml_visitor)(xml_file* file, const ResTable& res, void* data);
+
+    /*
+     * Open and parse several compiled XML files (res/xml/..., the
+     * manifest) from the resource set named by the cookie.  The entries
+     * are opened together as with openNonAssets(), then inflated and
+     * parsed by up to "numThreads" workers (0 picks one per CPU), each
+     * file into its own ResXMLTree.  If "visitor" is given it runs on
+     * the worker as soon as that file is parsed, and its result becomes
+     * the file's error.
+     *
+     * "outFiles[i]" describes fileNames[i]; a name that wasn't found has
+     * error NAME_NOT_FOUND.  Returns the number of files that parsed.
+     */
+    size_t openXmlTrees(void* cookie, const char* const* fileNames, size_t count,
+        xml_file* outFiles, xml_visitor visitor = NULL, void* data = NULL,
+        size_t numThreads = 0);
+    static void closeXmlTrees(xml_file* files, size_t count);
+
     /*
      * Open a directory within the asset hierarchy.
      *
@@ -223,12 +313,15 @@ private:
         String8 path;
         FileType type;
         String8 idmap;
+        String8 idmapTarget;    // overlay with an in-memory idmap onto this path
     };
 
     Asset* openInPathLocked(const char* fileName, AccessMode mode,
         const asset_path& path);
     Asset* openNonAssetInPathLocked(const char* fileName, AccessMode mode,
         const asset_path& path);
+    void prefetchNonAssetsInPathLocked(const char* const* fileNames,
+        size_t count, const asset_path& path);
     Asset* openInLocaleVendorLocked(const char* fileName, AccessMode mode,
         const asset_path& path, const char* locale, const char* vendor);
     String8 createPathNameLocked(const asset_path& path, const char* locale,
@@ -251,18 +344,19 @@ private:
         const SortedVector<AssetDir::FileInfo>* pContents);
 
     void loadFileNameCacheLocked(void);
-    void fncScanLocked(SortedVector<AssetDir::FileInfo>* pMergedInfo,
-        const char* dirName);
-    bool fncScanAndMergeDirLocked(
-        SortedVector<AssetDir::FileInfo>* pMergedInfo,
-        const asset_path& path, const char* locale, const char* vendor,
-        const char* dirName);
+    void fncScanLocked(const char* dirName);
+    bool fncScanAndMergeDirLocked(const asset_path& path, const char* locale,
+        const char* vendor, const char* dirName, uint32_t dims);
+    void invalidateFileNameCacheLocked(uint32_t dims);
     void purgeFileNameCacheLocked(void);
 
     const ResTable* getResTable(bool required = true) const;
     void setLocaleLocked(const char* locale);
     void updateResourceParamsLocked() const;
 
+    bool createIdmapLocked(const String8& originalPath, const String8& overlayPath,
+                           void** outData, size_t* outSize);
+
     bool createIdmapFileLocked(const String8& originalPath, const String8& overlayPath,
                                const String8& idmapPath);
 
@@ -284,6 +378,11 @@ private:
 
         ResTable* getResourceTable();
         ResTable* setResourceTable(ResTable* res);
+
+        // In-memory idmaps of this (overlay) package onto a target.
+        const void* getIdmap(const String8& targetPath, size_t* outSize);
+        const void* setIdmap(const String8& targetPath, void* data, size_t size,
+                             size_t* outSize);
         
         bool isUpToDate();
         
@@ -301,10 +400,75 @@ private:
         Asset* mResourceTableAsset;
         ResTable* mResourceTable;
 
+        struct idmap_data {
+            void* data;
+            size_t size;
+        };
+        KeyedVector<String8, idmap_data> mIdmaps;
+
         static Mutex gLock;
         static DefaultKeyedVector<String8, wp<SharedZip> > gOpen;
     };
 
+    /*
+     * Compact set of "extended partial" path names for the loose-file
+     * cache.  Names are interned back-to-back in a single arena and found
+     * through an open-addressed hash table, so a lookup is one hash and
+     * (usually) one memcmp, with no String8 allocation.
+     *
+     * Each name remembers the locale/vendor dimensions of the directory
+     * it was scanned from, so that changing the locale only discards the
+     * locale-specific names and leaves the rest of the cache intact.
+     */
+    class FileNameCache {
+    public:
+        enum {
+            kDimDefault = 0x01,     // scanned from "default/default"
+            kDimLocale  = 0x02,     // path includes the current locale
+            kDimVendor  = 0x04,     // path includes the current vendor
+            kDimAll     = 0x07,
+        };
+
+        FileNameCache(void);
+        ~FileNameCache(void);
+
+        void add(const char* name, size_t nameLen, uint32_t dims);
+        bool contains(const char* name, size_t nameLen) const;
+
+        /*
+         * Drop every name that was scanned under any of "dims".
+         */
+        void purge(uint32_t dims);
+        void clear(void);
+
+        size_t size(void) const { return mCount; }
+
+    private:
+        FileNameCache(const FileNameCache&); // <-- not implemented
+        FileNameCache& operator=(const FileNameCache&);
+
+        enum { kEmptySlot = 0xffffffff };
+
+        struct Entry {
+            uint32_t    hash;
+            uint32_t    offset;     // into mNames, kEmptySlot if unused
+            uint32_t    len;
+            uint32_t    dims;
+        };
+
+        static uint32_t computeHash(const char* str, size_t len);
+        ssize_t findSlot(const char* name, size_t nameLen, uint32_t hash) const;
+        bool grow(void);
+
+        char*       mNames;
+        size_t      mNamesLen;
+        size_t      mNamesAlloc;
+
+        Entry*      mTable;
+        size_t      mTableSize;     // always a power of 2
+        size_t      mCount;
+    };
+
     /*
      * Manage a set of Zip files.  For each file we need a pointer to the
      * ZipFile and a time_t with the file's modification date.
@@ -329,6 +493,11 @@ private:
         ResTable* getZipResourceTable(const String8& path);
         ResTable* setZipResourceTable(const String8& path, ResTable* res);
 
+        const void* getZipIdmap(const String8& path, const String8& targetPath,
+                                size_t* outSize);
+        const void* setZipIdmap(const String8& path, const String8& targetPath,
+                                void* data, size_t size, size_t* outSize);
+
         // generate path, e.g. "common/en-US-noogle.zip"
         static String8 getPathName(const char* path);
 
@@ -348,6 +517,7 @@ private:
     ZipSet          mZipSet;
 
     Vector<asset_path> mAssetPaths;
+    bool            mAnalysisMode;      // no overlay discovery or idmap files
     char*           mLocale;
     char*           mVendor;
 
@@ -362,10 +532,13 @@ private:
      *
      * We do not cache directory names.  We don't retain the ".gz",
      * because to our clients "foo" and "foo.gz" both look like "foo".
+     *
+     * "mCacheStale" holds the FileNameCache dimensions that must be
+     * rescanned before the cache can be used again.
      */
     CacheMode       mCacheMode;         // is the cache enabled?
-    bool            mCacheValid;        // clear when locale or vendor changes
-    SortedVector<AssetDir::FileInfo> mCache;
+    uint32_t        mCacheStale;        // set when locale or vendor changes
+    FileNameCache   mCache;
 };
 
 }; // namespace android
@@ -21,6 +21,11 @@
 
 #include <stdint.h>
 #include <sys/types.h>
+#if defined(__SSE2__)
+#include <emmintrin.h>
+#elif defined(__ARM_NEON__) || defined(__ARM_NEON)
+#include <arm_neon.h>
+#endif
 #ifdef HAVE_WINSOCK
 #include <winsock2.h>
 #else
@@ -48,6 +53,51 @@ static inline uint16_t android_swap_short(uint16_t v)
     return (v<<8) | (v>>8);
 }
 
+/*
+ * In-place swaps of whole arrays, for loading data written in the other
+ * byte order.  Vectorized where the compiler targets SSE2 or NEON.
+ */
+static inline void android_swap_longs(uint32_t* p, size_t n)
+{
+    size_t i = 0;
+#if defined(__SSE2__)
+    for (; i + 4 <= n; i += 4) {
+        __m128i v = _mm_loadu_si128((const __m128i*)(p + i));
+        v = _mm_or_si128(_mm_slli_epi16(v, 8), _mm_srli_epi16(v, 8));
+        v = _mm_shufflehi_epi16(_mm_shufflelo_epi16(v, 0xB1), 0xB1);
+        _mm_storeu_si128((__m128i*)(p + i), v);
+    }
+#elif defined(__ARM_NEON__) || defined(__ARM_NEON)
+    for (; i + 4 <= n; i += 4) {
+        uint8x16_t v = vld1q_u8((const uint8_t*)(p + i));
+        vst1q_u8((uint8_t*)(p + i), vrev32q_u8(v));
+    }
+#endif
+    for (; i < n; i++) {
+        p[i] = android_swap_long(p[i]);
+    }
+}
+
+static inline void android_swap_shorts(uint16_t* p, size_t n)
+{
+    size_t i = 0;
+#if defined(__SSE2__)
+    for (; i + 8 <= n; i += 8) {
+        __m128i v = _mm_loadu_si128((const __m128i*)(p + i));
+        v = _mm_or_si128(_mm_slli_epi16(v, 8), _mm_srli_epi16(v, 8));
+        _mm_storeu_si128((__m128i*)(p + i), v);
+    }
+#elif defined(__ARM_NEON__) || defined(__ARM_NEON)
+    for (; i + 8 <= n; i += 8) {
+        uint8x16_t v = vld1q_u8((const uint8_t*)(p + i));
+        vst1q_u8((uint8_t*)(p + i), vrev16q_u8(v));
+    }
+#endif
+    for (; i < n; i++) {
+        p[i] = android_swap_short(p[i]);
+    }
+}
+
 #define DEVICE_BYTE_ORDER LITTLE_ENDIAN
 
 #if BYTE_ORDER == DEVICE_BYTE_ORDER
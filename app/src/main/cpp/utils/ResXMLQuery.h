@@ -0,0 +1,143 @@
+/*
+ * Copyright (C) 2026 The aapt Authors
+ *
+ * Licensed under the Apache License, Version 2.0 (the "License");
+ * you may not use this file except in compliance with the License.
+ * You may obtain a copy of the License at
+ *
+ *      http://www.apache.org/licenses/LICENSE-2.0
+ *
+ * Unless required by applicable law or agreed to in writing, software
+ * distributed under the License is distributed on an "AS IS" BASIS,
+ * WITHOUT WARRANTIES OR CONDITIONS OF ANY KIND, either express or implied.
+ * See the License for the specific language governing permissions and
+ * limitations under the License.
+ */
+
+//
+// Path queries over binary XML, answered in one streaming pass.
+//
+#ifndef __LIBS_RESXMLQUERY_H
+#define __LIBS_RESXMLQUERY_H
+
+#include "ResourceTypes.h"
+#include "String8.h"
+#include "Vector.h"
+
+#include <stdint.h>
+#include <sys/types.h>
+
+namespace android {
+
+/*
+ * A set of selectors evaluated together over a ResXMLParser.  Each
+ * selector is a path of element steps from the root element:
+ *
+ *   manifest/application/meta-data[@android:name='com.example.key']/@android:value
+ *   manifest/application/provider/@android:authorities
+ *   manifest/queries/package/@android:name
+ *
+ * A step is an element name or '*'.  It can carry predicates, either
+ * [@attr] (the attribute is present) or [@attr='value'] (it has that
+ * string value).  A trailing /@attr extracts that attribute from each
+ * matching element that has it; without one the match is the element
+ * itself and its text is empty.  Attribute names may use the "android:"
+ * prefix; other prefixes are not understood.
+ *
+ * All names are looked up in the document's string pool once, when
+ * the document is started, so the per-element work is integer
+ * compares.  Matches are kept per query, in document order.
+ */
+class ResXMLQuery {
+public:
+    ResXMLQuery(void);
+    ~ResXMLQuery(void);
+
+    /* returns the new query's index, or BAD_VALUE for a bad selector */
+    ssize_t add(const char* selector);
+
+    size_t size(void) const { return mQueries.size(); }
+
+    /* restarts the parser and evaluates every query over the document */
+    status_t run(ResXMLParser& parser);
+
+    /*
+     * For a caller that walks the document itself: call begin() before
+     * the first event, then feed() each event that next() returns.
+     */
+    status_t begin(const ResXMLParser& parser);
+    void feed(const ResXMLParser& parser, ResXMLParser::event_code_t code);
+
+    size_t getMatchCount(size_t query) const;
+    /* the extracted attribute as text; empty for element matches */
+    const String8& getMatch(size_t query, size_t idx) const;
+    /* the extracted attribute's typed value; NULL for element matches */
+    const Res_value* getMatchValue(size_t query, size_t idx) const;
+
+private:
+    ResXMLQuery(const ResXMLQuery&);
+    ResXMLQuery& operator=(const ResXMLQuery&);
+
+    enum { MAX_NAME_INDICES = 4 };
+
+    // A name, and where it appears in the current document's pool.  A
+    // full 'indices' may not be all of them; see contains().
+    struct name_ref {
+        String8     text;
+        size_t      count;
+        uint32_t    indices[MAX_NAME_INDICES];
+    };
+
+    struct attr_ref {
+        bool        android;
+        name_ref    name;
+    };
+
+    struct predicate {
+        attr_ref    attr;
+        bool        hasValue;
+        name_ref    value;
+    };
+
+    struct step {
+        bool        any;
+        name_ref    name;
+        size_t      firstPredicate;
+        size_t      predicateCount;
+    };
+
+    struct match {
+        String8     text;
+        Res_value   value;
+        bool        hasValue;
+    };
+
+    struct query {
+        size_t      firstStep;
+        size_t      stepCount;
+        bool        extract;
+        attr_ref    attr;
+        size_t      matched;        // steps matched along the current path
+    };
+
+    static status_t parseName(const char** pos, String8* out);
+    static status_t parseAttr(const char** pos, attr_ref* out);
+
+    void resolve(const ResStringPool& pool, name_ref* ref) const;
+    bool contains(const name_ref& ref, int32_t index) const;
+    ssize_t findAttribute(const ResXMLParser& parser, const attr_ref& attr) const;
+    bool matchStep(const ResXMLParser& parser, const step& st) const;
+    void addMatch(const ResXMLParser& parser, size_t q);
+
+    Vector<query>           mQueries;
+    Vector<step>            mSteps;
+    Vector<predicate>       mPredicates;
+    Vector< Vector<match> > mMatches;       // by query
+    name_ref                mAndroidNs;
+    const ResStringPool*    mPool;          // the current document's
+    size_t                  mDepth;
+};
+
+}; // namespace android
+
+#endif // __LIBS_RESXMLQUERY_H
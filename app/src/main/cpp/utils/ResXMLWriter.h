@@ -0,0 +1,92 @@
+/*
+ * Copyright (C) 2026 The aapt Authors
+ *
+ * Licensed under the Apache License, Version 2.0 (the "License");
+ * you may not use this file except in compliance with the License.
+ * You may obtain a copy of the License at
+ *
+ *      http://www.apache.org/licenses/LICENSE-2.0
+ *
+ * Unless required by applicable law or agreed to in writing, software
+ * distributed under the License is distributed on an "AS IS" BASIS,
+ * WITHOUT WARRANTIES OR CONDITIONS OF ANY KIND, either express or implied.
+ * See the License for the specific language governing permissions and
+ * limitations under the License.
+ */
+
+//
+// Writes binary XML back out as text XML.
+//
+#ifndef __LIBS_RESXMLWRITER_H
+#define __LIBS_RESXMLWRITER_H
+
+#include "ResourceTypes.h"
+#include "Vector.h"
+
+#include <stdint.h>
+#include <sys/types.h>
+
+namespace android {
+
+/*
+ * Decompiles a binary XML document into indented text XML.
+ *
+ * Output goes either straight into a caller-supplied buffer or, through
+ * a fixed internal buffer, to a file descriptor.  Like snprintf(), the
+ * buffer form never writes past 'size' but keeps counting, so
+ * getLength() after write() says how big the buffer needed to be; a
+ * NULL buffer of size 0 just measures.
+ *
+ * Names and string values are copied out of the document's string pool
+ * (UTF-16 pools are converted a chunk at a time on the stack) and
+ * escaped on the way.  Typed values are written with
+ * Res_value::format(), so resource references come out as raw IDs.
+ * Nothing is allocated per node.
+ */
+class ResXMLWriter {
+public:
+    ResXMLWriter(char* buf, size_t size);
+    ResXMLWriter(int fd);
+    ~ResXMLWriter(void);
+
+    /*
+     * Restarts the parser and writes the whole document.  Returns
+     * BAD_TYPE if the document is malformed, or the error from a failed
+     * write to the fd.
+     */
+    status_t write(ResXMLParser& parser);
+
+    /* total bytes produced, including any that did not fit the buffer */
+    size_t getLength(void) const { return mLength; }
+
+private:
+    ResXMLWriter(const ResXMLWriter&);
+    ResXMLWriter& operator=(const ResXMLWriter&);
+
+    enum { FD_BUFFER_SIZE = 64*1024 };
+
+    struct ns_binding {
+        int32_t prefix;
+        int32_t uri;
+    };
+
+    void append(const char* str, size_t len);
+    void append(const char* str);
+    void appendEscaped(const char* str, size_t len, bool attr);
+    void appendString(const ResStringPool& pool, int32_t idx, bool attr);
+    void appendName(const ResXMLParser& parser, int32_t ns, int32_t name);
+    void appendIndent(size_t depth);
+    void flush(void);
+
+    char*               mBuf;
+    size_t              mSize;
+    size_t              mPos;       // bytes in mBuf
+    size_t              mLength;    // bytes produced
+    int                 mFd;
+    status_t            mError;
+    Vector<ns_binding>  mNamespaces;
+};
+
+}; // namespace android
+
+#endif // __LIBS_RESXMLWRITER_H
@@ -23,6 +23,7 @@
 #include "Asset.h"
 #include "ByteOrder.h"
 #include "Errors.h"
+#include "SortedVector.h"
 #include "String16.h"
 #include "Vector.h"
 
@@ -330,6 +331,12 @@ struct Res_value
     uint32_t data;
 
     void copyFrom_dtoh(const Res_value& src);
+
+    // Writes the value as it would appear in XML source ("@0x7f020001",
+    // "true", "16.0dip", "#ff000000", ...), snprintf-style.  A string
+    // value is only an index into some pool, so TYPE_STRING writes
+    // nothing; look the string up instead.
+    int format(char* buf, size_t bufSize) const;
 };
 
 /**
@@ -442,19 +449,47 @@ public:
 
     status_t getError() const;
 
+    // Checks every string and style entry (offsets, length prefixes,
+    // terminators, span lists) in one sweep; see the .cpp for why this
+    // is not done by setTo().
+    status_t validate() const;
+
     void uninit();
 
+    // Decodes every UTF-8 string into one contiguous UTF-16 slab up front,
+    // for callers that are going to touch most of the pool.  Large pools
+    // are split across a few worker threads.  Does nothing for UTF-16
+    // pools.
+    status_t decodeAllStrings() const;
+
     inline const uint16_t* stringAt(const ResStringPool_ref& ref, size_t* outLen) const {
         return stringAt(ref.index, outLen);
     }
     const uint16_t* stringAt(size_t idx, size_t* outLen) const;
 
+    // For UTF-8 pools, returns the string in place with its length in
+    // bytes; returns NULL for UTF-16 pools.
     const char* string8At(size_t idx, size_t* outLen) const;
 
+    // Returns the string as UTF-8, transcoding only if the pool is UTF-16.
+    String8 string8ObjectAt(size_t idx) const;
+
+    // Compares string 'idx' against UTF-8 'str' without decoding a
+    // UTF-8 pool to UTF-16.
+    bool string8Equals(size_t idx, const char* str, size_t strLen) const;
+
     const ResStringPool_span* styleAt(const ResStringPool_ref& ref) const;
     const ResStringPool_span* styleAt(size_t idx) const;
 
     ssize_t indexOfString(const uint16_t* str, size_t strLen) const;
+    ssize_t indexOfString8(const char* str, size_t strLen) const;
+
+    // A pool can hold the same string more than once; this fills in up
+    // to 'maxIndices' of the matching indices and returns how many it
+    // stored.  A return of 'maxIndices' means there may be more, in no
+    // particular order.
+    size_t indicesOfString8(const char* str, size_t strLen,
+                            uint32_t* outIndices, size_t maxIndices) const;
 
     size_t size() const;
 
@@ -463,15 +498,32 @@ public:
 #endif
 
 private:
+    struct decode_chunk;
+    struct string_index;
+
+    uint16_t* allocDecodeBuffer(size_t count) const;
+    uint16_t* cachedString(size_t idx) const;
+    uint16_t* publishString(size_t idx, uint16_t* str) const;
+    const uint8_t* utf8StringAt(size_t idx, size_t* u16len, size_t* u8len) const;
+    void decodeRange(size_t start, size_t end, uint16_t* dest) const;
+    static void* decodeRangeThread(void* arg);
+    const string_index* getStringIndex() const;
+    ssize_t indexOfRawString(const string_index* index, const void* str, size_t strLen) const;
+
     status_t                    mError;
     void*                       mOwnedData;
     const ResStringPool_header* mHeader;
     size_t                      mSize;
-    mutable Mutex               mDecodeLock;
+    mutable Mutex               mDecodeLock;    // guards mDecodeChunks only
+    mutable decode_chunk*       mDecodeChunks;
     const uint32_t*             mEntries;
     const uint32_t*             mEntryStyles;
     const void*                 mStrings;
-    uint16_t**                  mCache;
+    // Decode cache for UTF-8 pools, in pages of slots allocated on first
+    // use.  Pages and slots are published with CAS and read lock-free.
+    uint16_t* volatile* volatile* mCache;
+    size_t                      mCachePages;
+    mutable string_index* volatile mIndex;      // built on first lookup, same scheme
     uint32_t                    mStringPoolSize;    // number of uint16_t
     const uint32_t*             mStyles;
     uint32_t                    mStylePoolSize;    // number of uint32_t
@@ -631,6 +683,21 @@ public:
         const void*                 curExt;
     };
 
+    // One start element, as recorded by ResXMLTree::INDEX_ELEMENTS.
+    // Elements are numbered in document order, so the descendants of
+    // an element are the run of elements after it with greater depth.
+    struct ResXMLElement
+    {
+        const ResXMLTree_node*      node;           // the START_TAG node
+        const ResXMLTree_node*      endNode;        // its END_TAG; NULL if never closed
+        uint32_t                    depth;          // 0 for the root element
+        ssize_t                     parent;         // -1 for the root element
+        ssize_t                     firstChild;     // -1 if none
+        ssize_t                     nextSibling;    // -1 if none
+        int32_t                     nameID;
+        uint32_t                    attributeCount;
+    };
+
     void restart();
 
     const ResStringPool& getStrings() const;
@@ -661,6 +728,15 @@ public:
     const uint16_t* getElementNamespace(size_t* outLen) const;
     int32_t getElementNameID() const;
     const uint16_t* getElementName(size_t* outLen) const;
+
+    // UTF-8 views of the above.  These return NULL unless the document's
+    // string pool is stored as UTF-8; the string is not copied.
+    const char* getElementName8(size_t* outLen) const;
+    bool elementNameEquals(const char* name) const;
+
+    // The code ResXMLTree::setElementCodes() gave this element's name,
+    // or 0 if it has none.
+    uint32_t getElementCode() const;
     
     // Remaining methods are for retrieving information about attributes
     // associated with a START_TAG:
@@ -677,6 +753,10 @@ public:
     
     int32_t getAttributeValueStringID(size_t idx) const;
     const uint16_t* getAttributeStringValue(size_t idx, size_t* outLen) const;
+
+    const char* getAttributeNamespace8(size_t idx, size_t* outLen) const;
+    const char* getAttributeName8(size_t idx, size_t* outLen) const;
+    const char* getAttributeStringValue8(size_t idx, size_t* outLen) const;
     
     int32_t getAttributeDataType(size_t idx) const;
     int32_t getAttributeData(size_t idx) const;
@@ -686,6 +766,13 @@ public:
     ssize_t indexOfAttribute(const uint16_t* ns, size_t nsLen,
                              const uint16_t* attr, size_t attrLen) const;
 
+    // Finds several attributes by resource ID in one pass over the
+    // element.  'resIds' must be sorted ascending; outIndices[i] is set
+    // to the index of the attribute named by resIds[i], or to
+    // NAME_NOT_FOUND.  Returns how many were found.
+    size_t gatherAttributes(const uint32_t* resIds, size_t count,
+                            ssize_t* outIndices) const;
+
     ssize_t indexOfID() const;
     ssize_t indexOfClass() const;
     ssize_t indexOfStyle() const;
@@ -693,8 +780,23 @@ public:
     void getPosition(ResXMLPosition* pos) const;
     void setPosition(const ResXMLPosition& pos);
 
+    // Random access through the element index.  These find nothing
+    // unless the tree was set up with ResXMLTree::INDEX_ELEMENTS.
+    size_t getElementCount() const;
+    const ResXMLElement* getElement(size_t idx) const;
+    // Index of the element whose START_TAG is the current event.
+    ssize_t getElementIndex() const;
+    // Positions the parser on the element's START_TAG; next() then
+    // continues from there.
+    status_t seekToElement(size_t idx);
+    // Positions the parser on the element's END_TAG, skipping its
+    // whole subtree.
+    status_t seekToElementEnd(size_t idx);
+
 private:
     friend class ResXMLTree;
+
+    status_t seekToNode(const ResXMLTree_node* node);
     
     event_code_t nextNode();
 
@@ -702,6 +804,7 @@ private:
     event_code_t                mEventCode;
     const ResXMLTree_node*      mCurNode;
     const void*                 mCurExt;
+    size_t                      mCurIndex;      // into the tree's node index, if any
 };
 
 /**
@@ -710,20 +813,66 @@ private:
 class ResXMLTree : public ResXMLParser
 {
 public:
+    enum {
+        // Validate every node once in setTo() and remember where each
+        // one is; traversals then step through that list instead of
+        // re-validating each node they visit.  A document that is bad
+        // part way through still parses up to the bad node, as without
+        // the index.
+        INDEX_NODES = 0x0001,
+        // Record every start element with its depth, parent, first
+        // child, next sibling and name, for the random access calls
+        // in ResXMLParser.  Built in the same pass as INDEX_NODES.
+        INDEX_ELEMENTS = 0x0002
+    };
+
     ResXMLTree();
     ResXMLTree(const void* data, size_t size, bool copyData=false);
     ~ResXMLTree();
 
-    status_t setTo(const void* data, size_t size, bool copyData=false);
+    status_t setTo(const void* data, size_t size, bool copyData=false,
+                   uint32_t flags=0);
+    // Parses in place, without copying, and holds a reference to the
+    // data until the tree is uninitialized or set to something else.
+    status_t setTo(const sp<AssetData>& data, uint32_t flags=0);
 
     status_t getError() const;
 
+    // Gives element names small integer codes for getElementCode():
+    // names[i] gets code i+1, whatever namespace it is in.  The names
+    // are looked up in the string pool once, here, so dispatching on
+    // an element is an array lookup.  Call after setTo(); replaces any
+    // earlier codes.
+    status_t setElementCodes(const char* const* names, size_t count);
+
     void uninit();
 
 private:
     friend class ResXMLParser;
 
+    enum { MAX_QUERY_INDICES = 4, MAX_ATTR_QUERIES = 16 };
+
+    // An attribute lookup by name, resolved to string pool indices.
+    struct attr_query {
+        const char* ns;
+        const char* attr;
+        size_t      nsCount;
+        size_t      nameCount;
+        uint32_t    nsIndices[MAX_QUERY_INDICES];
+        uint32_t    nameIndices[MAX_QUERY_INDICES];
+    };
+
+    // One pre-validated node, as nextNode() would have produced it.
+    struct node_entry {
+        const ResXMLTree_node*  node;
+        const void*             ext;
+        event_code_t            code;
+    };
+
     status_t validateNode(const ResXMLTree_node* node) const;
+    status_t buildNodeIndex(bool indexElements);
+    ssize_t indexOfNode(const ResXMLTree_node* node) const;
+    void resolveAttrQuery(const char* ns, const char* attr, attr_query* outQuery) const;
 
     status_t                    mError;
     void*                       mOwnedData;
@@ -736,6 +885,15 @@ private:
     const ResXMLTree_node*      mRootNode;
     const void*                 mRootExt;
     event_code_t                mRootCode;
+    mutable Mutex               mAttrQueryLock; // guards mAttrQueries only
+    mutable Vector<attr_query>  mAttrQueries;
+    node_entry*                 mNodes;
+    size_t                      mNodeCount;
+    event_code_t                mNodesEnd;      // END_DOCUMENT or BAD_DOCUMENT
+    Vector<ResXMLElement>       mElements;
+    uint16_t*                   mElementCodes;  // by string pool index
+    size_t                      mElementCodeCount;
+    sp<AssetData>               mPinned;
 };
 
 /** ********************************************************************
@@ -1816,6 +1974,13 @@ public:
                  bool copyData=false, const void* idmap = NULL);
     status_t add(Asset* asset, void* cookie,
                  bool copyData=false, const void* idmap = NULL);
+    // As above, with the idmap given as raw bytes (e.g. straight from
+    // createIdmap()) instead of as an Asset.
+    status_t add(Asset* asset, void* cookie, const void* idmapData,
+                 size_t idmapSize, bool copyData=false);
+    // Adds the table in place, without copying, and keeps a reference
+    // to the data for as long as the table uses it.
+    status_t add(const sp<AssetData>& data, void* cookie);
     status_t add(ResTable* src);
 
     status_t getError() const;
@@ -1865,6 +2030,23 @@ public:
                              uint32_t* inoutTypeSpecFlags = NULL,
                              ResTable_config* outConfig = NULL) const;
 
+    /**
+     * Look up one resource under several configurations at once, without
+     * using or changing the table's parameters.  The resource's type
+     * chunks are walked once, each being matched against every
+     * requested configuration, instead of once per setParameters().
+     *
+     * For each i, outValues[i] and outBlocks[i] get what getResource()
+     * followed by resolveReference() would give with configs[i] as the
+     * parameters; outBlocks[i] is negative if there is no value.
+     *
+     * @return NO_ERROR, or an error for a bad resource identifier or a
+     * malformed table.
+     */
+    status_t getResourceForConfigs(uint32_t resID, const ResTable_config* configs,
+                                   size_t count, Res_value* outValues,
+                                   ssize_t* outBlocks) const;
+
     enum {
         TMP_BUFFER_SIZE = 16
     };
@@ -2062,6 +2244,10 @@ public:
 
     void getLocales(Vector<String8>* locales) const;
 
+    // Both of the above are kept as each table is added, in the order
+    // each configuration or locale first appears, so into an empty
+    // vector they are a copy.
+
     // Generate an idmap.
     //
     // Return value: on success: NO_ERROR; caller is responsible for free-ing
@@ -2093,7 +2279,8 @@ private:
     struct bag_set;
 
     status_t add(const void* data, size_t size, void* cookie,
-                 Asset* asset, bool copyData, const Asset* idmap);
+                 Asset* asset, bool copyData, const void* idmapData,
+                 size_t idmapSize);
 
     ssize_t getResourcePackageIndex(uint32_t resID) const;
     ssize_t getEntry(
@@ -2105,6 +2292,11 @@ private:
         const ResTable_package* const pkg, const Header* const header, uint32_t idmap_id);
 
     void print_value(const Package* pkg, const Res_value& value) const;
+
+    status_t addConfiguration(const ResTable_config& config);
+    status_t findResourceForConfigs(uint32_t resID, const ResTable_config* configs,
+                                    size_t count, Res_value* outValues,
+                                    ssize_t* outBlocks) const;
     
     mutable Mutex               mLock;
 
@@ -2121,6 +2313,16 @@ private:
     // Mapping from resource package IDs to indices into the internal
     // package array.
     uint8_t                     mPackageMap[256];
+
+    // Distinct configurations of all type chunks, first seen first, and
+    // an open-addressed hash of them (index+1, 0 for an empty slot).
+    Vector<ResTable_config>     mConfigs;
+    uint32_t*                   mConfigSlots;
+    size_t                      mConfigSlotCount;   // always a power of 2
+
+    // Distinct locales among mConfigs, and their packed language/country.
+    Vector<String8>             mLocales;
+    SortedVector<uint32_t>      mLocaleKeys;
 };
 
 }   // namespace android
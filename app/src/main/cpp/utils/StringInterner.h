@@ -0,0 +1,100 @@
+/*
+ * Copyright (C) 2026 The aapt Authors
+ *
+ * Licensed under the Apache License, Version 2.0 (the "License");
+ * you may not use this file except in compliance with the License.
+ * You may obtain a copy of the License at
+ *
+ *      http://www.apache.org/licenses/LICENSE-2.0
+ *
+ * Unless required by applicable law or agreed to in writing, software
+ * distributed under the License is distributed on an "AS IS" BASIS,
+ * WITHOUT WARRANTIES OR CONDITIONS OF ANY KIND, either express or implied.
+ * See the License for the specific language governing permissions and
+ * limitations under the License.
+ */
+
+//
+// Maps UTF-8 strings to small integer atoms.
+//
+#ifndef __LIBS_STRINGINTERNER_H
+#define __LIBS_STRINGINTERNER_H
+
+#include "Errors.h"
+#include "Vector.h"
+
+#include <stdint.h>
+#include <sys/types.h>
+
+namespace android {
+
+class ResStringPool;
+
+/*
+ * A string interner for one analysis pass.  Each distinct string gets a
+ * 32-bit atom, assigned in order starting at 1, so a caller that interns
+ * a fixed list of names first can treat their atoms as constants.  The
+ * interned bytes are NUL-terminated and never move until the interner is
+ * destroyed.
+ *
+ * Strings can also be interned straight out of a ResStringPool, with the
+ * pool-index -> atom mapping remembered per pool; the XML tree's pool and
+ * the resource table's pools then share one atom space.  Pools must
+ * outlive the interner (or be dropped with forgetPool()).
+ *
+ * Not thread-safe.
+ */
+class StringInterner {
+public:
+    enum { NO_ATOM = 0 };
+
+    StringInterner(void);
+    ~StringInterner(void);
+
+    uint32_t intern(const char* str, size_t len);
+    uint32_t intern(const char* str);
+
+    /* returns NO_ATOM if the string has not been interned */
+    uint32_t find(const char* str, size_t len) const;
+
+    /* returns NULL for NO_ATOM or an unknown atom */
+    const char* string(uint32_t atom, size_t* outLen = NULL) const;
+
+    /* atom for string 'idx' of 'pool'; NO_ATOM if there is no such string */
+    uint32_t atomAt(const ResStringPool& pool, ssize_t idx);
+
+    void forgetPool(const ResStringPool& pool);
+
+    size_t size(void) const { return mAtoms.size() - 1; }
+
+private:
+    StringInterner(const StringInterner&);
+    StringInterner& operator=(const StringInterner&);
+
+    struct atom_info {
+        const char* str;
+        uint32_t    len;
+        uint32_t    hash;
+    };
+
+    struct pool_atoms {
+        const ResStringPool*    pool;
+        uint32_t*               atoms;
+        size_t                  count;
+    };
+
+    struct name_chunk;
+
+    const char* copyName(const char* str, size_t len);
+    status_t rehash(size_t buckets);
+
+    Vector<atom_info>   mAtoms;         // [0] is a placeholder for NO_ATOM
+    uint32_t*           mTable;         // open-addressed, holds atoms
+    size_t              mTableMask;
+    name_chunk*         mChunks;
+    Vector<pool_atoms>  mPools;
+};
+
+}; // namespace android
+
+#endif // __LIBS_STRINGINTERNER_H
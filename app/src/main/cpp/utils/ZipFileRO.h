@@ -140,6 +140,22 @@ public:
      */
     FileMap* createEntryFileMap(ZipEntryRO entry) const;
 
+    /*
+     * Pull the data for a set of entries into the page cache.  The entries
+     * are sorted by local file header offset and neighbours are coalesced,
+     * so several scattered reads become one (or a few) sequential ones.
+     *
+     * This is only a performance hint; entries that are bogus are ignored.
+     */
+    void prefetchEntries(const ZipEntryRO* entries, int count) const;
+
+    /*
+     * Tell the kernel we're done with this archive, so its pages can be
+     * dropped from the page cache.  Handy when walking through a great
+     * many archives that will each be looked at once.
+     */
+    void releasePages(void) const;
+
     /*
      * Uncompress the data into a buffer.  Depending on the compression
      * format, this is either an "inflate" operation or a memcpy.
@@ -66,4 +66,14 @@ public class MainActivity extends AppCompatActivity {
     }
 
     public native String getApkInfo(String path);
+
+    // Fields for getApkIdentity(); must match IDENTITY_* in native-lib.cpp.
+    public static final int IDENTITY_PACKAGE = 0x0001;
+    public static final int IDENTITY_SDK = 0x0002;
+    public static final int IDENTITY_LAUNCHABLE = 0x0004;
+    public static final int IDENTITY_ALL = 0x0007;
+
+    public native String getApkIdentity(String path, int fields);
+
+    public native String getXmlTree(String path, String entry);
 }